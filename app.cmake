@@ -0,0 +1,40 @@
+# The FSM, the command path and the LED library with its generated
+# headers: the part of the application that runs without Bluetooth.
+# Shared by the application (CMakeLists.txt) and the test images under
+# tests/, which bring their own main() and fakes for the rest.
+set(APP_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+target_sources(app PRIVATE
+			${APP_DIR}/src/app_fsm.c
+			${APP_DIR}/src/cmd_queue.c
+  			${APP_DIR}/led_strip_src/led_strip.c
+			${APP_DIR}/led_strip_src/led_anim.c
+			${APP_DIR}/led_strip_src/led_frame.c
+			${APP_DIR}/led_strip_src/led_stream.c
+)
+target_sources_ifdef(CONFIG_SAMPLE_LED_OUT_DRIVER app PRIVATE ${APP_DIR}/led_strip_src/led_out_strip.c)
+target_sources_ifdef(CONFIG_SAMPLE_LED_OUT_SPI app PRIVATE ${APP_DIR}/led_strip_src/led_out_spi.c)
+target_sources_ifdef(CONFIG_SAMPLE_LED_OUT_EMUL app PRIVATE ${APP_DIR}/led_strip_src/led_out_emul.c)
+target_sources_ifdef(CONFIG_SAMPLE_FSM_TRACE app PRIVATE ${APP_DIR}/src/fsm_trace.c)
+target_include_directories(app PRIVATE ${APP_DIR})
+
+# Host clock for timing on the simulated boards, see src/perf_clock.h
+if(CONFIG_NATIVE_LIBRARY)
+  target_sources(native_simulator INTERFACE ${APP_DIR}/src/perf_clock_host.c)
+endif()
+
+# Gamma/brightness table for the LED color pipeline, built from Kconfig
+set(GEN_DIR ${CMAKE_CURRENT_BINARY_DIR}/generated)
+set(GAMMA_LUT_H ${GEN_DIR}/led_gamma_lut.h)
+add_custom_command(
+  OUTPUT ${GAMMA_LUT_H}
+  COMMAND ${CMAKE_COMMAND} -E make_directory ${GEN_DIR}
+  COMMAND ${PYTHON_EXECUTABLE} ${APP_DIR}/led_strip_src/gen_gamma_lut.py
+          --max-level ${CONFIG_SAMPLE_LED_BRIGHTNESS}
+          --gamma-x10 ${CONFIG_SAMPLE_LED_GAMMA_X10}
+          -o ${GAMMA_LUT_H}
+  DEPENDS ${APP_DIR}/led_strip_src/gen_gamma_lut.py ${AUTOCONF_H}
+)
+add_custom_target(led_gamma_lut DEPENDS ${GAMMA_LUT_H})
+add_dependencies(app led_gamma_lut)
+target_include_directories(app PRIVATE ${GEN_DIR})
@@ -0,0 +1,88 @@
+/*
+ * Brightness buttons on top of the gpio-keys input driver.
+ *
+ * Debounce is done by gpio-keys (debounce-interval-ms in the overlay).
+ * This module adds auto-repeat while a key is held and coalesces steps so
+ * the FSM only refreshes the strip once per burst.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/input/input.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/devicetree.h>
+
+#include "button.h"
+
+#define KEY_INCR DT_PROP(DT_ALIAS(brightness_incr), zephyr_code)
+#define KEY_DECR DT_PROP(DT_ALIAS(brightness_decr), zephyr_code)
+
+#define REPEAT_DELAY    K_MSEC(CONFIG_SAMPLE_BUTTON_REPEAT_DELAY_MS)
+#define REPEAT_INTERVAL K_MSEC(CONFIG_SAMPLE_BUTTON_REPEAT_INTERVAL_MS)
+
+static atomic_t pending_steps;
+static button_step_cb_t step_cb;
+static atomic_t held_dir; // +1, -1 or 0 while no key is held
+
+static void button_step(int dir)
+{
+	atomic_add(&pending_steps, dir);
+	if (step_cb != NULL) {
+		step_cb();
+	}
+}
+
+static void repeat_fn(struct k_work *work)
+{
+	int dir = (int)atomic_get(&held_dir);
+
+	if (dir == 0) {
+		return;
+	}
+
+	button_step(dir);
+	k_work_reschedule(k_work_delayable_from_work(work), REPEAT_INTERVAL);
+}
+
+static K_WORK_DELAYABLE_DEFINE(repeat_work, repeat_fn);
+
+static void button_input_cb(struct input_event *evt, void *user_data)
+{
+	int dir;
+
+	if (evt->type != INPUT_EV_KEY) {
+		return;
+	}
+
+	if (evt->code == KEY_INCR) {
+		dir = 1;
+	} else if (evt->code == KEY_DECR) {
+		dir = -1;
+	} else {
+		return;
+	}
+
+	if (evt->value) {
+		// press: one step now, auto-repeat after the hold delay
+		atomic_set(&held_dir, dir);
+		button_step(dir);
+		k_work_reschedule(&repeat_work, REPEAT_DELAY);
+	} else if (atomic_cas(&held_dir, dir, 0)) {
+		// release of the key that is repeating
+		k_work_cancel_delayable(&repeat_work);
+	}
+}
+
+INPUT_CALLBACK_DEFINE(NULL, button_input_cb, NULL);
+
+int button_init(button_step_cb_t cb)
+{
+	step_cb = cb;
+	atomic_clear(&pending_steps);
+	return 0;
+}
+
+int button_take_steps(void)
+{
+	return (int)atomic_clear(&pending_steps);
+}
@@ -0,0 +1,28 @@
+#ifndef BUTTON_H
+#define BUTTON_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Called from the input thread whenever brightness steps are pending */
+typedef void (*button_step_cb_t)(void);
+
+/** @brief Start listening to the brightness buttons via the input subsystem */
+int button_init(button_step_cb_t cb);
+
+/**
+ * @brief Take the net brightness steps accumulated since the last call.
+ *
+ * Presses and auto-repeats are coalesced, so a burst of presses is
+ * returned as one value (positive = brighter).
+ */
+int button_take_steps(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BUTTON_H
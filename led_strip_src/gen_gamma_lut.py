@@ -0,0 +1,36 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""Generate the 8-bit gamma correction table used by led_strip.c.
+
+The table maps a brightness-scaled channel value (0-255) to the value sent
+to the LED, including the CONFIG_SAMPLE_LED_BRIGHTNESS output ceiling.
+"""
+
+import argparse
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--max-level", type=int, required=True,
+                        help="output level for a full-scale input (1-255)")
+    parser.add_argument("--gamma-x10", type=int, required=True,
+                        help="gamma exponent times ten, 10 = linear")
+    parser.add_argument("-o", "--output", required=True)
+    args = parser.parse_args()
+
+    gamma = args.gamma_x10 / 10.0
+    table = [round(((i / 255.0) ** gamma) * args.max_level) for i in range(256)]
+
+    with open(args.output, "w") as f:
+        f.write("/* Generated by gen_gamma_lut.py, do not edit */\n\n")
+        f.write("#pragma once\n\n#include <stdint.h>\n\n")
+        f.write(f"/* gamma {gamma:.1f}, max level {args.max_level} */\n")
+        f.write("static const uint8_t led_gamma_lut[256] = {\n")
+        for row in range(0, 256, 16):
+            vals = ", ".join(f"{v:3d}" for v in table[row:row + 16])
+            f.write(f"\t{vals},\n")
+        f.write("};\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,320 @@
+/*
+ * Non-blocking LED animation engine.
+ *
+ * Frames are rendered on a dedicated work queue at a fixed frame period.
+ * Deadlines are absolute so the frame rate does not drift, and frames that
+ * come out identical to the previous one never reach the driver.
+ *
+ * Every zone runs its own animation. A frame starts as a copy of the last
+ * one and only the zones still animating are drawn into it, zone 0 first
+ * and the other zones over it. Starting zone 0 ends them all.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(led_anim, LOG_LEVEL_INF);
+
+#include "led_strip.h"
+#include "led_internal.h"
+#include "src/perf_clock.h"
+
+#define FRAME_MS        CONFIG_SAMPLE_LED_FRAME_MS
+#define DEFAULT_PERIOD  1000 // ms, used when duration is 0 for periodic effects
+
+struct led_anim {
+	uint8_t mode;
+	struct led_rgb from;  // linear color the fade starts at
+	struct led_rgb to;    // linear target color
+	uint32_t period_ms;   // fade length or effect period
+	uint16_t scale;       // brightness of streamed frames, 8.8 fixed point
+	int64_t start;        // uptime of frame 0
+	uint32_t gen;         // bumped by every start, tags committed frames
+	uint32_t stamp;       // cycle count when it was started
+};
+
+static K_THREAD_STACK_DEFINE(led_workq_stack, CONFIG_SAMPLE_LED_RENDER_STACK_SIZE);
+static struct k_work_q led_workq;
+
+BUILD_ASSERT(LED_ZONES <= 32, "zones are tracked in 32-bit masks");
+
+static struct k_spinlock anim_lock;
+static struct led_anim pending[LED_ZONES];  // written by led_anim_start()
+static uint32_t pending_mask;
+static uint32_t gen_counter;
+
+/* Owned by the work queue; running is also read by led_anim_busy() */
+static struct led_anim anims[LED_ZONES];
+static struct led_rgb current[LED_ZONES];   // last solid color shown, linear
+static uint32_t running;                    // zones still animating, anim_lock
+static uint32_t overrides;                  // zones drawn over zone 0
+static int64_t deadline;
+
+static led_strip_idle_cb_t idle_cb;
+
+#if defined(CONFIG_SAMPLE_LED_ANIM_STATS)
+static uint32_t stat_frames;
+static uint32_t stat_pushed;
+static uint32_t stat_render_max;  // perf_clock units
+static uint64_t stat_render_sum;  // perf_clock units
+static uint32_t stat_jitter_max;  // ms
+
+static void anim_stats(int64_t now, uint32_t render, bool pushed)
+{
+	stat_frames++;
+	stat_pushed += pushed;
+	stat_render_sum += render;
+	stat_render_max = MAX(stat_render_max, render);
+	stat_jitter_max = MAX(stat_jitter_max, (uint32_t)(now - deadline));
+
+	if (stat_frames == CONFIG_SAMPLE_LED_ANIM_STATS_FRAMES) {
+		struct led_frame_stats fs;
+
+		led_frame_get_stats(&fs);
+		LOG_INF("frames %u pushed %u, frame time avg %u ns max %u ns, jitter max %u ms",
+			stat_frames, stat_pushed,
+			(uint32_t)perf_clock_to_ns(stat_render_sum / stat_frames),
+			(uint32_t)perf_clock_to_ns(stat_render_max), stat_jitter_max);
+		LOG_INF("tx: sent %u superseded %u errors %u, transfer last %u us (%u px) max %u us",
+			fs.sent, fs.superseded, fs.errors,
+			k_cyc_to_us_floor32(fs.tx_cycles_last), fs.tx_pixels_last,
+			k_cyc_to_us_floor32(fs.tx_cycles_max));
+		LOG_INF("tx: encode last %u ns max %u ns, palette full %u",
+			(uint32_t)perf_clock_to_ns(fs.encode_time_last),
+			(uint32_t)perf_clock_to_ns(fs.encode_time_max), fs.palette_full);
+		stat_frames = 0;
+		stat_pushed = 0;
+		stat_render_sum = 0;
+		stat_render_max = 0;
+		stat_jitter_max = 0;
+	}
+}
+#else
+static inline void anim_stats(int64_t now, uint32_t render, bool pushed) {}
+#endif /* CONFIG_SAMPLE_LED_ANIM_STATS */
+
+static inline uint8_t lerp8(uint8_t a, uint8_t b, uint16_t w)
+{
+	return a + (((b - a) * (int32_t)w) >> 8);
+}
+
+static void fill(struct led_frame *f, uint8_t z, struct led_rgb linear)
+{
+	led_frame_fill_range(f, led_zones[z].start, led_zones[z].start + led_zones[z].len,
+			     led_color_gamma(linear));
+}
+
+/*
+ * Render frame t (ms since start) of zone @p z; returns false once the
+ * animation is done
+ */
+static bool anim_render(struct led_frame *f, uint8_t z, uint32_t t)
+{
+	const struct led_anim *anim = &anims[z];
+	uint32_t phase = anim->period_ms ? t % anim->period_ms : 0;
+	struct led_rgb c;
+	uint16_t w;
+
+	switch (anim->mode) {
+	case LED_MODE_BLINK:
+		fill(f, z, phase < anim->period_ms / 2 ? anim->to : (struct led_rgb){ 0 });
+		return true;
+
+	case LED_MODE_BREATHE:
+		// triangle wave 0..256..0, gamma makes it look smooth
+		w = (phase * 512U) / anim->period_ms;
+		fill(f, z, led_color_dim(anim->to, w <= 256 ? w : 512 - w));
+		return true;
+
+	case LED_MODE_CHASE:
+		fill(f, z, (struct led_rgb){ 0 });
+		led_frame_set(f, led_zones[z].start + (phase * led_zones[z].len) / anim->period_ms,
+			      led_color_gamma(anim->to));
+		return true;
+
+	case LED_MODE_STREAM:
+		// one frame per led_anim_stream_show(), always the whole strip
+		led_stream_render(f, anim->scale);
+		return false;
+
+	default:
+		// solid modes fade from the previous color
+		if (t >= anim->period_ms) {
+			current[z] = anim->to;
+			fill(f, z, current[z]);
+			return false;
+		}
+		w = (t * 256U) / anim->period_ms;
+		c.r = lerp8(anim->from.r, anim->to.r, w);
+		c.g = lerp8(anim->from.g, anim->to.g, w);
+		c.b = lerp8(anim->from.b, anim->to.b, w);
+		fill(f, z, c);
+		return true;
+	}
+}
+
+/*
+ * Take over the animations started since the last frame. Called with
+ * anim_lock held, so pending_mask and running change together and
+ * led_anim_busy() never sees a gap between them.
+ */
+static void anim_pickup(uint32_t picked, int64_t now)
+{
+	if (picked & BIT(0)) {
+		// zone 0 repaints the whole strip, zones started before it are moot
+		for (uint8_t z = 1; z < LED_ZONES; z++) {
+			if ((picked & BIT(z)) && anims[z].gen < anims[0].gen) {
+				picked &= ~BIT(z);
+			}
+		}
+		running = 0;
+		overrides = 0;
+	}
+
+	for (uint8_t z = 0; z < LED_ZONES; z++) {
+		if (!(picked & BIT(z))) {
+			continue;
+		}
+		// a zone shows zone 0 until it gets its own animation
+		anims[z].from = current[(z == 0 || (overrides & BIT(z))) ? z : 0];
+		anims[z].start = now;
+		running |= BIT(z);
+		if (z) {
+			overrides |= BIT(z);
+		}
+	}
+	deadline = now;
+}
+
+static void anim_frame_fn(struct k_work *work)
+{
+	k_spinlock_key_t key = k_spin_lock(&anim_lock);
+	const struct led_anim *newest = &anims[0];
+	int64_t now = k_uptime_get();
+	struct led_frame *f;
+	uint32_t picked;
+	uint32_t draw;
+	uint32_t done = 0;
+	uint32_t start;
+	int rc;
+
+	picked = pending_mask;
+	for (uint8_t z = 0; z < LED_ZONES; z++) {
+		if (picked & BIT(z)) {
+			anims[z] = pending[z];
+		}
+	}
+	pending_mask = 0;
+	if (picked) {
+		anim_pickup(picked, now);
+	}
+	k_spin_unlock(&anim_lock, key);
+
+	// render and commit only, neither sleeps
+	start = perf_clock_get();
+	f = led_frame_back();
+	// a running zone 0 paints over everything, so the other zones go on top again
+	draw = (running & BIT(0)) ? (running | overrides) : running;
+	for (uint8_t z = 0; z < LED_ZONES; z++) {
+		if (!(draw & BIT(z))) {
+			continue;
+		}
+		if (!anim_render(f, z, (uint32_t)(now - anims[z].start))) {
+			done |= BIT(z);
+		}
+		if (anims[z].gen > newest->gen) {
+			newest = &anims[z];
+		}
+	}
+	rc = led_frame_commit(newest->gen, newest->stamp);
+	anim_stats(now, perf_clock_get() - start, rc > 0);
+
+	// only after the commit, so the last frame is queued before busy drops
+	key = k_spin_lock(&anim_lock);
+	running &= ~done;
+	k_spin_unlock(&anim_lock, key);
+
+	if (!running && draw && idle_cb) {
+		idle_cb();
+	}
+
+	if (running) {
+		deadline += FRAME_MS;
+		if (deadline <= now) {
+			// overran the frame budget, drop the missed frames
+			deadline = now + FRAME_MS;
+		}
+		k_work_schedule_for_queue(&led_workq, k_work_delayable_from_work(work),
+					  K_TIMEOUT_ABS_MS(deadline));
+	}
+}
+
+static K_WORK_DELAYABLE_DEFINE(frame_work, anim_frame_fn);
+
+uint32_t led_anim_start(uint8_t zone, uint8_t mode, struct led_rgb color, uint8_t duration)
+{
+	k_spinlock_key_t key;
+	uint32_t period = duration * LED_DURATION_UNIT_MS;
+	uint32_t gen;
+
+	__ASSERT_NO_MSG(zone < LED_ZONES);
+
+	if (period == 0 && mode >= LED_MODE_BLINK) {
+		period = DEFAULT_PERIOD;
+	}
+
+	key = k_spin_lock(&anim_lock);
+	pending[zone].mode = mode;
+	pending[zone].to = color;
+	pending[zone].period_ms = period;
+	pending[zone].gen = gen = ++gen_counter;
+	pending[zone].stamp = k_cycle_get_32();
+	pending_mask |= BIT(zone);
+	k_spin_unlock(&anim_lock, key);
+
+	// the next frame picks up the new animation immediately
+	k_work_reschedule_for_queue(&led_workq, &frame_work, K_NO_WAIT);
+	return gen;
+}
+
+void led_anim_stream_show(uint16_t scale)
+{
+	k_spinlock_key_t key = k_spin_lock(&anim_lock);
+
+	pending[0].mode = LED_MODE_STREAM;
+	pending[0].scale = scale;
+	pending[0].gen = ++gen_counter;
+	pending[0].stamp = k_cycle_get_32();
+	pending_mask |= BIT(0);
+	k_spin_unlock(&anim_lock, key);
+
+	k_work_reschedule_for_queue(&led_workq, &frame_work, K_NO_WAIT);
+}
+
+bool led_anim_busy(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&anim_lock);
+	bool busy = pending_mask || running;
+
+	k_spin_unlock(&anim_lock, key);
+	return busy;
+}
+
+void led_strip_set_idle_cb(led_strip_idle_cb_t cb)
+{
+	idle_cb = cb;
+}
+
+static int led_anim_init(void)
+{
+	k_work_queue_start(&led_workq, led_workq_stack,
+			   K_THREAD_STACK_SIZEOF(led_workq_stack),
+			   CONFIG_SAMPLE_LED_RENDER_PRIORITY, NULL);
+	k_thread_name_set(&led_workq.thread, "led_render");
+	return 0;
+}
+
+SYS_INIT(led_anim_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
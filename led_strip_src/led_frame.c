@@ -0,0 +1,441 @@
+/*
+ * Asynchronous frame submission to the LED strip.
+ *
+ * The output backend blocks for the whole transfer, so it runs on its own
+ * "led_tx" work queue. The renderer submits a frame and moves on to the
+ * next one while the previous transfer is still on the wire. Only the most
+ * recent frame is kept queued: submitting again supersedes a frame that has
+ * not started yet.
+ *
+ * Three buffers are enough: one in flight, one queued and one being
+ * rendered. The last submitted frame is never handed out for rendering so
+ * unchanged frames can be detected by comparing against it.
+ *
+ * Frames are solid or per pixel. Per-pixel frames are a struct led_rgb or,
+ * with CONFIG_SAMPLE_LED_FRAME_PALETTE, a palette index per pixel.
+ *
+ * Each frame carries the pixel range that may differ from the one submitted
+ * before it. The range is trimmed to the pixels that really changed, and
+ * only those are encoded; the transfer stops after the last one, since
+ * WS2812 pixels that are not clocked keep their color.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(led_frame, LOG_LEVEL_INF);
+
+#include "led_strip.h"
+#include "led_internal.h"
+#include "src/perf_clock.h"
+
+#define NUM_FRAMES 3
+#define NO_FRAME   -1
+
+static struct led_frame frames[NUM_FRAMES];
+
+static struct k_spinlock frame_lock;
+static int8_t render = NO_FRAME;    // owned by the renderer
+static int8_t queued = NO_FRAME;    // waiting for the tx queue
+static int8_t inflight = NO_FRAME;  // being sent
+static int8_t latest = NO_FRAME;    // last submitted, matches the strip soon
+static bool resend_all = true;      // strip state unknown, send every pixel
+
+static struct led_frame_stats stats;
+static led_strip_event_cb_t event_cb;
+
+static inline void frame_event(enum led_strip_event evt, uint32_t start)
+{
+	if (event_cb) {
+		event_cb(evt, start);
+	}
+}
+
+#if defined(CONFIG_SAMPLE_LATENCY_TRACE) || defined(CONFIG_SAMPLE_DIAG)
+#define FRAME_TAGS 1
+/*
+ * Each frame remembers the animation generation it was rendered for. The
+ * first time a generation reaches the strip a "trace: px" line goes out,
+ * which scripts/bsim_load.py pairs with the "trace: apply" line from
+ * led_strip_control(), and the event callback gets LED_STRIP_FIRST_PIXELS.
+ * Called with frame_lock held.
+ */
+static uint32_t frame_gen[NUM_FRAMES];
+static uint32_t frame_stamp[NUM_FRAMES];
+static uint32_t shown_gen;
+
+static void trace_shown(uint32_t gen, uint32_t stamp)
+{
+	if (gen != shown_gen) {
+		shown_gen = gen;
+		frame_event(LED_STRIP_FIRST_PIXELS, stamp);
+#if defined(CONFIG_SAMPLE_LATENCY_TRACE)
+		printk("trace: px gen %u t %llu\n", gen, k_ticks_to_us_floor64(k_uptime_ticks()));
+#endif
+	}
+}
+#endif /* CONFIG_SAMPLE_LATENCY_TRACE || CONFIG_SAMPLE_DIAG */
+
+static inline bool rgb_equal(struct led_rgb a, struct led_rgb b)
+{
+	return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+static inline void mark_dirty(struct led_frame *f, size_t lo, size_t hi)
+{
+	f->dirty_lo = MIN(f->dirty_lo, lo);
+	f->dirty_hi = MAX(f->dirty_hi, hi);
+}
+
+void led_frame_fill(struct led_frame *f, struct led_rgb c)
+{
+	f->solid = true;
+	f->color = c;
+	mark_dirty(f, 0, STRIP_NUM_PIXELS);
+}
+
+void led_frame_fill_range(struct led_frame *f, size_t lo, size_t hi, struct led_rgb c)
+{
+	if (lo == 0 && hi >= STRIP_NUM_PIXELS) {
+		led_frame_fill(f, c);
+		return;
+	}
+	for (size_t i = lo; i < hi; i++) {
+		led_frame_set(f, i, c);
+	}
+}
+
+#if defined(CONFIG_SAMPLE_LED_FRAME_PALETTE)
+static uint8_t palette_nearest(const struct led_frame *f, struct led_rgb c)
+{
+	uint32_t best = UINT32_MAX;
+	uint8_t idx = 0;
+
+	for (uint8_t i = 0; i < f->ncolors; i++) {
+		uint32_t d = abs(f->palette[i].r - c.r) + abs(f->palette[i].g - c.g) +
+			     abs(f->palette[i].b - c.b);
+
+		if (d < best) {
+			best = d;
+			idx = i;
+		}
+	}
+	return idx;
+}
+
+static uint8_t palette_index(struct led_frame *f, struct led_rgb c)
+{
+	k_spinlock_key_t key;
+
+	for (uint8_t i = 0; i < f->ncolors; i++) {
+		if (rgb_equal(f->palette[i], c)) {
+			return i;
+		}
+	}
+
+	if (f->ncolors < LED_FRAME_COLORS) {
+		f->palette[f->ncolors] = c;
+		return f->ncolors++;
+	}
+
+	key = k_spin_lock(&frame_lock);
+	stats.palette_full++;
+	k_spin_unlock(&frame_lock, key);
+	return palette_nearest(f, c);
+}
+
+void led_frame_set(struct led_frame *f, size_t i, struct led_rgb c)
+{
+	if (f->solid) {
+		if (rgb_equal(f->color, c)) {
+			return;
+		}
+		f->solid = false;
+		f->ncolors = 1;
+		f->palette[0] = f->color;
+		memset(f->idx, 0, sizeof(f->idx));
+	}
+	f->idx[i] = palette_index(f, c);
+	mark_dirty(f, i, i + 1);
+}
+
+/* Drop the colors no pixel uses any more, the frame is reused as a base */
+static void palette_compact(struct led_frame *f)
+{
+	uint8_t map[LED_FRAME_COLORS];
+	uint8_t n = 0;
+
+	memset(map, 0xff, sizeof(map));
+	for (size_t i = 0; i < STRIP_NUM_PIXELS; i++) {
+		uint8_t old = f->idx[i];
+
+		if (map[old] == 0xff) {
+			map[old] = n;
+			f->palette[n++] = f->palette[old];
+		}
+		f->idx[i] = map[old];
+	}
+	f->ncolors = n;
+}
+#else
+void led_frame_set(struct led_frame *f, size_t i, struct led_rgb c)
+{
+	if (f->solid) {
+		if (rgb_equal(f->color, c)) {
+			return;
+		}
+		f->solid = false;
+		for (size_t j = 0; j < STRIP_NUM_PIXELS; j++) {
+			f->px[j] = f->color;
+		}
+	}
+	f->px[i] = c;
+	mark_dirty(f, i, i + 1);
+}
+#endif /* CONFIG_SAMPLE_LED_FRAME_PALETTE */
+
+/*
+ * Shrink the dirty range of @p f to the pixels that differ from @p prev;
+ * the range ends up empty when the frames are equal.
+ */
+static void frame_trim(struct led_frame *f, const struct led_frame *prev)
+{
+	size_t lo = f->dirty_lo;
+	size_t hi = f->dirty_hi;
+
+	if (f->solid && prev->solid && rgb_equal(f->color, prev->color)) {
+		hi = lo;
+	}
+	while (lo < hi && rgb_equal(led_frame_px(f, lo), led_frame_px(prev, lo))) {
+		lo++;
+	}
+	while (hi > lo && rgb_equal(led_frame_px(f, hi - 1), led_frame_px(prev, hi - 1))) {
+		hi--;
+	}
+	f->dirty_lo = lo;
+	f->dirty_hi = hi;
+}
+
+/* Any pixel on, checked only until the first lit frame went out */
+static bool frame_lit(const struct led_frame *f)
+{
+	for (size_t i = 0; i < (f->solid ? 1 : STRIP_NUM_PIXELS); i++) {
+		struct led_rgb c = led_frame_px(f, i);
+
+		if (c.r | c.g | c.b) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static K_THREAD_STACK_DEFINE(led_txq_stack, CONFIG_SAMPLE_LED_TX_STACK_SIZE);
+static struct k_work_q led_txq;
+
+static void frame_tx_fn(struct k_work *work)
+{
+	k_spinlock_key_t key;
+	uint32_t encode;
+	uint32_t start;
+	size_t lo = 0, hi = 0;
+	int8_t idx;
+	bool lit;
+	int rc;
+
+	for (;;) {
+		key = k_spin_lock(&frame_lock);
+		idx = queued;
+		queued = NO_FRAME;
+		inflight = idx;
+		if (idx != NO_FRAME) {
+			lo = resend_all ? 0 : frames[idx].dirty_lo;
+			hi = resend_all ? STRIP_NUM_PIXELS : frames[idx].dirty_hi;
+			resend_all = false;
+		}
+		k_spin_unlock(&frame_lock, key);
+
+		if (idx == NO_FRAME) {
+			return;
+		}
+
+		lit = stats.first_light_us == 0 && frame_lit(&frames[idx]);
+
+		// CPU only, so the host clock times it on the simulators
+		start = perf_clock_get();
+		led_out_encode(&frames[idx], lo, hi);
+		encode = perf_clock_get() - start;
+
+		start = k_cycle_get_32();
+		rc = led_out_send(hi);
+		if (rc == 0) {
+			frame_event(LED_STRIP_FRAME_SENT, start);
+		}
+		start = k_cycle_get_32() - start;
+
+		key = k_spin_lock(&frame_lock);
+		inflight = NO_FRAME;
+		if (rc) {
+			stats.errors++;
+			// force the next frame out in full, even if it is identical
+			resend_all = true;
+		} else {
+			stats.sent++;
+			stats.tx_cycles_max = MAX(stats.tx_cycles_max, start);
+#if defined(FRAME_TAGS)
+			trace_shown(frame_gen[idx], frame_stamp[idx]);
+#endif
+		}
+		stats.tx_cycles_last = start;
+		stats.tx_pixels_last = hi;
+		stats.encode_time_last = encode;
+		stats.encode_time_max = MAX(stats.encode_time_max, encode);
+		k_spin_unlock(&frame_lock, key);
+
+		if (rc) {
+			LOG_ERR("LED update failed: %d", rc);
+		} else if (lit) {
+			stats.first_light_us = k_ticks_to_us_floor32(k_uptime_ticks());
+			LOG_INF("Time to first light: %u us", stats.first_light_us);
+		}
+	}
+}
+
+static K_WORK_DEFINE(frame_tx_work, frame_tx_fn);
+
+static bool frame_busy(int8_t idx)
+{
+	return idx == queued || idx == inflight || idx == latest;
+}
+
+struct led_frame *led_frame_back(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&frame_lock);
+	int8_t prev = latest;
+	struct led_frame *f;
+
+	if (render == NO_FRAME || frame_busy(render)) {
+		for (int8_t i = 0; i < NUM_FRAMES; i++) {
+			if (!frame_busy(i)) {
+				render = i;
+				break;
+			}
+		}
+	}
+	k_spin_unlock(&frame_lock, key);
+
+	__ASSERT_NO_MSG(render != NO_FRAME);
+	f = &frames[render];
+
+	// start from what the strip is about to show, submitted frames are read-only
+	if (prev == NO_FRAME) {
+		f->solid = true;
+		f->color = (struct led_rgb){ 0 };
+	} else if (frames[prev].solid) {
+		f->solid = true;
+		f->color = frames[prev].color;
+	} else {
+		*f = frames[prev];
+#if defined(CONFIG_SAMPLE_LED_FRAME_PALETTE)
+		if (f->ncolors == LED_FRAME_COLORS) {
+			palette_compact(f);
+		}
+#endif
+	}
+	f->dirty_lo = STRIP_NUM_PIXELS;
+	f->dirty_hi = 0;
+	if (prev == NO_FRAME) {
+		mark_dirty(f, 0, STRIP_NUM_PIXELS);
+	}
+	return f;
+}
+
+int led_frame_commit(uint32_t gen, uint32_t stamp)
+{
+	k_spinlock_key_t key = k_spin_lock(&frame_lock);
+	int8_t prev = latest;
+	bool resend = resend_all;
+
+	k_spin_unlock(&frame_lock, key);
+
+	// submitted frames are read-only, so compare without holding the lock
+	if (resend) {
+		mark_dirty(&frames[render], 0, STRIP_NUM_PIXELS);
+	} else if (prev != NO_FRAME) {
+		frame_trim(&frames[render], &frames[prev]);
+	}
+	if (prev != NO_FRAME && !resend &&
+	    frames[render].dirty_lo >= frames[render].dirty_hi) {
+		key = k_spin_lock(&frame_lock);
+		stats.unchanged++;
+#if defined(FRAME_TAGS)
+		// the strip already shows it once the previous frame is out
+		frame_gen[prev] = gen;
+		frame_stamp[prev] = stamp;
+		if (prev != queued && prev != inflight) {
+			trace_shown(gen, stamp);
+		}
+#endif
+		k_spin_unlock(&frame_lock, key);
+		return 0;
+	}
+
+	key = k_spin_lock(&frame_lock);
+#if defined(FRAME_TAGS)
+	frame_gen[render] = gen;
+	frame_stamp[render] = stamp;
+#endif
+	if (queued != NO_FRAME) {
+		stats.superseded++;  // never made it to the strip
+		// its changes did not either
+		mark_dirty(&frames[render], frames[queued].dirty_lo, frames[queued].dirty_hi);
+	}
+	queued = render;
+	latest = render;
+	render = NO_FRAME;
+	stats.submitted++;
+	k_spin_unlock(&frame_lock, key);
+
+	frame_event(LED_STRIP_FRAME_PUSHED, 0);
+	k_work_submit_to_queue(&led_txq, &frame_tx_work);
+	return 1;
+}
+
+void led_frame_get_stats(struct led_frame_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&frame_lock);
+
+	*out = stats;
+	k_spin_unlock(&frame_lock, key);
+}
+
+void led_strip_set_event_cb(led_strip_event_cb_t cb)
+{
+	event_cb = cb;
+}
+
+bool led_frame_dark(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&frame_lock);
+	int8_t prev = latest;
+	bool idle = queued == NO_FRAME && inflight == NO_FRAME;
+
+	k_spin_unlock(&frame_lock, key);
+
+	// nothing was ever sent: the strip powers up dark
+	return idle && (prev == NO_FRAME || !frame_lit(&frames[prev]));
+}
+
+static int led_frame_init(void)
+{
+	k_work_queue_start(&led_txq, led_txq_stack,
+			   K_THREAD_STACK_SIZEOF(led_txq_stack),
+			   CONFIG_SAMPLE_LED_TX_PRIORITY, NULL);
+	k_thread_name_set(&led_txq.thread, "led_tx");
+	return 0;
+}
+
+SYS_INIT(led_frame_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
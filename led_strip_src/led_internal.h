@@ -0,0 +1,161 @@
+#pragma once
+
+/*
+ * Shared between the LED strip sources only; the app uses led_strip.h.
+ */
+
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/led_strip.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if DT_NODE_HAS_PROP(DT_ALIAS(led_strip), chain_length)
+#define STRIP_NUM_PIXELS	DT_PROP(DT_ALIAS(led_strip), chain_length)
+#else
+#error Unable to determine length of LED strip
+#endif
+
+/** A run of consecutive pixels addressed as one, see LED_ZONES */
+struct led_zone {
+	uint16_t start;
+	uint16_t len;
+};
+
+/** Zone 0 is the whole strip */
+extern const struct led_zone led_zones[LED_ZONES];
+
+/** 8.8 fixed-point multiplier for a 0-100 brightness */
+uint16_t led_brightness_scale(uint8_t brightness);
+
+/** Scale a color in linear space (before gamma), scale is 8.8 fixed point */
+struct led_rgb led_color_dim(struct led_rgb c, uint16_t scale);
+
+/** Apply gamma and the output ceiling to a linear color */
+struct led_rgb led_color_gamma(struct led_rgb c);
+
+/** Frame submission counters, see led_frame_get_stats() */
+struct led_frame_stats {
+	uint32_t submitted;      // frames handed to the tx queue
+	uint32_t superseded;     // queued frames replaced before being sent
+	uint32_t unchanged;      // frames skipped because nothing changed
+	uint32_t sent;           // transfers completed
+	uint32_t errors;         // transfers the driver rejected
+	uint32_t tx_cycles_last; // duration of the last transfer
+	uint32_t tx_pixels_last; // pixels clocked out by the last transfer
+	uint32_t tx_cycles_max;
+	uint32_t encode_time_last; // frame to output format, perf_clock units
+	uint32_t encode_time_max;
+	uint32_t palette_full;   // pixels shown with the nearest palette color
+	uint32_t first_light_us; // uptime when the first lit frame was sent
+};
+
+/** Colors a frame can hold in the palette frame format */
+#define LED_FRAME_COLORS 16
+
+/**
+ * One strip frame, gamma already applied. A solid frame is a single color
+ * and its per-pixel data is stale; led_frame_set() expands it on demand.
+ * The palette format keeps a byte per pixel instead of a struct led_rgb.
+ * Pixels [dirty_lo, dirty_hi) may differ from the previous frame, the rest
+ * are known to match it.
+ */
+struct led_frame {
+	bool solid;
+	struct led_rgb color;    // the solid color
+	uint16_t dirty_lo;
+	uint16_t dirty_hi;
+#if defined(CONFIG_SAMPLE_LED_FRAME_PALETTE)
+	uint8_t ncolors;
+	struct led_rgb palette[LED_FRAME_COLORS];
+	uint8_t idx[STRIP_NUM_PIXELS];
+#else
+	struct led_rgb px[STRIP_NUM_PIXELS];
+#endif
+};
+
+/** Make @p f a solid frame of color @p c */
+void led_frame_fill(struct led_frame *f, struct led_rgb c);
+
+/** Set pixels [@p lo, @p hi) to @p c; the whole strip makes a solid frame */
+void led_frame_fill_range(struct led_frame *f, size_t lo, size_t hi, struct led_rgb c);
+
+/** Set pixel @p i; a full palette falls back to the nearest color */
+void led_frame_set(struct led_frame *f, size_t i, struct led_rgb c);
+
+/** Color of pixel @p i */
+static inline struct led_rgb led_frame_px(const struct led_frame *f, size_t i)
+{
+	if (f->solid) {
+		return f->color;
+	}
+#if defined(CONFIG_SAMPLE_LED_FRAME_PALETTE)
+	return f->palette[f->idx[i]];
+#else
+	return f->px[i];
+#endif
+}
+
+/**
+ * Buffer the next frame is rendered into. It starts as a copy of the last
+ * submitted frame with nothing dirty, so only changed zones need drawing.
+ */
+struct led_frame *led_frame_back(void);
+
+/**
+ * Queue the back buffer for transfer and return immediately. A queued
+ * frame that has not started yet is replaced. Returns 0 without queueing
+ * when the frame matches the last one submitted, 1 otherwise. @p gen is
+ * the animation generation the frame belongs to and @p stamp the cycle
+ * count it was started at, both used for latency tracing.
+ */
+int led_frame_commit(uint32_t gen, uint32_t stamp);
+
+/** Snapshot of the submission counters */
+void led_frame_get_stats(struct led_frame_stats *out);
+
+/** The last submitted frame has no pixel on and is out on the strip */
+bool led_frame_dark(void);
+
+/** Internal mode that shows the streamed canvas, never sent over the air */
+#define LED_MODE_STREAM 0xFF
+
+/**
+ * Start an animation for a command in @p zone; called with the color in
+ * linear space. Zone 0 ends every other zone's animation. Returns the
+ * animation generation, which tags the frames it renders.
+ */
+uint32_t led_anim_start(uint8_t zone, uint8_t mode, struct led_rgb color, uint8_t duration);
+
+/** Render the streamed canvas on the whole strip, scale is 8.8 fixed point */
+void led_anim_stream_show(uint16_t scale);
+
+/** An animation is running or about to start */
+bool led_anim_busy(void);
+
+/** Convert the streamed canvas into a strip frame */
+void led_stream_render(struct led_frame *f, uint16_t scale);
+
+/*
+ * Output backend, one per build (CONFIG_SAMPLE_LED_OUTPUT). Only the
+ * led_tx work queue calls encode and send, in that order.
+ */
+
+/** Check the hardware is there */
+int led_out_init(void);
+
+/**
+ * Convert pixels [@p lo, @p hi) of @p f into the backend's transfer buffer,
+ * which still holds the previous frame elsewhere. A backend that can't
+ * keep it encodes more.
+ */
+void led_out_encode(const struct led_frame *f, size_t lo, size_t hi);
+
+/**
+ * Send the first @p n pixels of the last encoded frame; blocks for the
+ * whole transfer. WS2812 pixels past @p n keep what they show.
+ */
+int led_out_send(size_t n);
+
+/** Hold (@p on) or release the hardware between frames */
+int led_out_power(bool on);
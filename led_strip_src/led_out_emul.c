@@ -0,0 +1,121 @@
+/*
+ * Emulated WS2812 transports for native_sim.
+ *
+ * Each transport encodes into the buffer its real driver would fill, so
+ * the encode time and buffer size are the real thing. The wire is a
+ * WS2812 at 800 kbit/s: DMA transports (SPI, I2S) sleep for the transfer,
+ * GPIO bit-banging keeps the CPU busy for it. Compare the "tx:" lines of
+ * CONFIG_SAMPLE_LED_ANIM_STATS across transports.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(led_out, LOG_LEVEL_INF);
+
+#include "led_internal.h"
+
+#define BIT_NS    1250              // 800 kbit/s
+#define WIRE_PX_US(n) ((n) * 24 * BIT_NS / 1000)
+#define WIRE_US   WIRE_PX_US(STRIP_NUM_PIXELS)
+#define RESET_US  80
+
+#if defined(CONFIG_SAMPLE_LED_EMUL_SPI)
+#define TRANSPORT "spi"
+#define PX_WORDS  24
+
+/* 8 SPI bits per WS2812 bit at 6.4 MHz, like the ws2812-spi driver */
+#define ONE_FRAME  0xF0
+#define ZERO_FRAME 0xC0
+#define BIT_FRAME(b, n) (((b) >> (n)) & 1 ? ONE_FRAME : ZERO_FRAME)
+#define LUT_ROW(b, _) { BIT_FRAME(b, 7), BIT_FRAME(b, 6), BIT_FRAME(b, 5), BIT_FRAME(b, 4), \
+			BIT_FRAME(b, 3), BIT_FRAME(b, 2), BIT_FRAME(b, 1), BIT_FRAME(b, 0) }
+
+static const uint8_t bit_lut[256][8] = {
+	LISTIFY(256, LUT_ROW, (,))
+};
+
+static uint8_t buf[STRIP_NUM_PIXELS * 24];
+
+static inline void encode_px(uint8_t *out, struct led_rgb c)
+{
+	memcpy(out, bit_lut[c.g], 8);
+	memcpy(out + 8, bit_lut[c.r], 8);
+	memcpy(out + 16, bit_lut[c.b], 8);
+}
+
+#elif defined(CONFIG_SAMPLE_LED_EMUL_I2S)
+#define TRANSPORT "i2s"
+#define PX_WORDS  3
+
+/* 4 I2S bits per WS2812 bit at 3.2 MHz, a 32-bit word per color byte */
+#define NIBBLE(b, n) ((((b) >> (n)) & 1 ? 0xEU : 0x8U) << (4 * (n)))
+#define LUT_WORD(b, _) (NIBBLE(b, 7) | NIBBLE(b, 6) | NIBBLE(b, 5) | NIBBLE(b, 4) | \
+			NIBBLE(b, 3) | NIBBLE(b, 2) | NIBBLE(b, 1) | NIBBLE(b, 0))
+
+static const uint32_t bit_lut[256] = {
+	LISTIFY(256, LUT_WORD, (,))
+};
+
+// the reset time is sent as zero words after the pixels
+static uint32_t buf[STRIP_NUM_PIXELS * 3 + DIV_ROUND_UP(RESET_US * 1000, 32 * BIT_NS / 4)];
+
+static inline void encode_px(uint32_t *out, struct led_rgb c)
+{
+	out[0] = bit_lut[c.g];
+	out[1] = bit_lut[c.r];
+	out[2] = bit_lut[c.b];
+}
+
+#else
+#define TRANSPORT "gpio"
+#define PX_WORDS  1
+
+/* Bit-banged straight from the pixels, nothing beyond the RGB copy */
+static struct led_rgb buf[STRIP_NUM_PIXELS];
+
+static inline void encode_px(struct led_rgb *out, struct led_rgb c)
+{
+	*out = c;
+}
+#endif
+
+static bool powered = true;
+
+int led_out_init(void)
+{
+	LOG_INF("Emulated %s strip: %u pixels, %zu B buffered, %u us on the wire",
+		TRANSPORT, STRIP_NUM_PIXELS, sizeof(buf), WIRE_US + RESET_US);
+	return 0;
+}
+
+void led_out_encode(const struct led_frame *f, size_t lo, size_t hi)
+{
+	for (size_t i = lo; i < hi; i++) {
+		encode_px(&buf[i * PX_WORDS], led_frame_px(f, i));
+	}
+}
+
+int led_out_send(size_t n)
+{
+	if (!powered) {
+		LOG_WRN("Frame sent with the transport released");
+	}
+#if defined(CONFIG_SAMPLE_LED_EMUL_GPIO)
+	// the real driver runs with interrupts locked for the whole strip
+	k_busy_wait(WIRE_PX_US(n));
+	k_usleep(RESET_US);
+#else
+	k_usleep(WIRE_PX_US(n) + RESET_US);
+#endif
+	return 0;
+}
+
+/* Nothing to release, only flags frames the power logic let through */
+int led_out_power(bool on)
+{
+	powered = on;
+	return 0;
+}
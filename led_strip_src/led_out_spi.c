@@ -0,0 +1,142 @@
+/*
+ * WS2812 over SPI without the Zephyr driver.
+ *
+ * Every color bit goes out as one SPI byte, spi-one-frame or
+ * spi-zero-frame. The byte-to-bitstream table is built at compile time
+ * from the strip's devicetree node, and so is the channel order from
+ * color-mapping, so encoding a pixel is three table lookups. Solid frames
+ * are encoded once and copied; palette frames encode each palette color
+ * once. Only the changed pixels are re-encoded, the rest of the bitstream
+ * still holds the previous frame. The transfer buffer is the only
+ * per-pixel SPI memory; the driver and its own buffer are left out
+ * (CONFIG_WS2812_STRIP_SPI=n).
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/dt-bindings/led/led.h>
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(led_out, LOG_LEVEL_INF);
+
+#include "led_internal.h"
+
+#define STRIP_NODE      DT_ALIAS(led_strip)
+#define ONE_FRAME       DT_PROP(STRIP_NODE, spi_one_frame)
+#define ZERO_FRAME      DT_PROP(STRIP_NODE, spi_zero_frame)
+#define RESET_DELAY_US  DT_PROP_OR(STRIP_NODE, reset_delay, 8)
+
+#define PX_BYTES        (3 * 8)  // three channels, a byte per bit
+
+BUILD_ASSERT(DT_PROP_LEN(STRIP_NODE, color_mapping) == 3,
+	     "only RGB strips are supported");
+
+/* Same bus settings as the ws2812-spi driver */
+#define SPI_OP (SPI_OP_MODE_MASTER | SPI_TRANSFER_MSB | SPI_WORD_SET(8) |    \
+		DT_PROP_OR(STRIP_NODE, frame_format, 0) |                     \
+		COND_CODE_1(DT_PROP(STRIP_NODE, spi_cpol), (SPI_MODE_CPOL), (0)) | \
+		COND_CODE_1(DT_PROP(STRIP_NODE, spi_cpha), (SPI_MODE_CPHA), (0)))
+
+static const struct spi_dt_spec bus = SPI_DT_SPEC_GET(STRIP_NODE, SPI_OP, 0);
+
+/* Color byte -> 8 SPI bytes, MSB first */
+#define BIT_FRAME(b, n) (((b) >> (n)) & 1 ? ONE_FRAME : ZERO_FRAME)
+#define LUT_ROW(b, _) { BIT_FRAME(b, 7), BIT_FRAME(b, 6), BIT_FRAME(b, 5), BIT_FRAME(b, 4), \
+			BIT_FRAME(b, 3), BIT_FRAME(b, 2), BIT_FRAME(b, 1), BIT_FRAME(b, 0) }
+
+static const uint8_t bit_lut[256][8] = {
+	LISTIFY(256, LUT_ROW, (,))
+};
+
+/* Wire order of the channels as offsets into struct led_rgb */
+#define CHANNEL(node, prop, i)                                                  \
+	(DT_PROP_BY_IDX(node, prop, i) == LED_COLOR_ID_RED ? offsetof(struct led_rgb, r) : \
+	 DT_PROP_BY_IDX(node, prop, i) == LED_COLOR_ID_GREEN ? offsetof(struct led_rgb, g) : \
+	 offsetof(struct led_rgb, b))
+
+static const uint8_t channels[3] = {
+	DT_FOREACH_PROP_ELEM_SEP(STRIP_NODE, color_mapping, CHANNEL, (,))
+};
+
+static uint8_t bitstream[STRIP_NUM_PIXELS * PX_BYTES];
+
+static inline void encode_px(uint8_t *out, struct led_rgb c)
+{
+	const uint8_t *ch = (const uint8_t *)&c;
+
+	memcpy(out, bit_lut[ch[channels[0]]], 8);
+	memcpy(out + 8, bit_lut[ch[channels[1]]], 8);
+	memcpy(out + 16, bit_lut[ch[channels[2]]], 8);
+}
+
+int led_out_init(void)
+{
+	if (!spi_is_ready_dt(&bus)) {
+		LOG_ERR("SPI bus %s is not ready", bus.bus->name);
+		return -ENODEV;
+	}
+
+	LOG_INF("WS2812 encoder on %s, %u pixels, %zu B buffer", bus.bus->name,
+		STRIP_NUM_PIXELS, sizeof(bitstream));
+	// held between frames, led_out_power() lets go of it in deep idle
+	(void)pm_device_runtime_enable(bus.bus);
+	return pm_device_runtime_get(bus.bus);
+}
+
+void led_out_encode(const struct led_frame *f, size_t lo, size_t hi)
+{
+	if (lo >= hi) {
+		return;
+	}
+
+	if (f->solid) {
+		encode_px(&bitstream[lo * PX_BYTES], f->color);
+		for (size_t i = lo + 1; i < hi; i++) {
+			memcpy(&bitstream[i * PX_BYTES], &bitstream[lo * PX_BYTES], PX_BYTES);
+		}
+		return;
+	}
+
+#if defined(CONFIG_SAMPLE_LED_FRAME_PALETTE)
+	static uint8_t encoded[LED_FRAME_COLORS][PX_BYTES];
+
+	for (uint8_t i = 0; i < f->ncolors; i++) {
+		encode_px(encoded[i], f->palette[i]);
+	}
+	for (size_t i = lo; i < hi; i++) {
+		memcpy(&bitstream[i * PX_BYTES], encoded[f->idx[i]], PX_BYTES);
+	}
+#else
+	for (size_t i = lo; i < hi; i++) {
+		encode_px(&bitstream[i * PX_BYTES], f->px[i]);
+	}
+#endif
+}
+
+int led_out_send(size_t n)
+{
+	const struct spi_buf buf = {
+		.buf = bitstream,
+		.len = n * PX_BYTES,
+	};
+	const struct spi_buf_set tx = {
+		.buffers = &buf,
+		.count = 1,
+	};
+	int rc;
+
+	rc = spi_write_dt(&bus, &tx);
+	// the line idles low, the strip latches after the reset time
+	k_usleep(RESET_DELAY_US);
+	return rc;
+}
+
+int led_out_power(bool on)
+{
+	return on ? pm_device_runtime_get(bus.bus) : pm_device_runtime_put(bus.bus);
+}
@@ -0,0 +1,74 @@
+/*
+ * Output through the Zephyr LED strip driver.
+ *
+ * The driver takes a struct led_rgb per pixel and may reorder it in
+ * place, so frames are expanded into a scratch buffer first. That also
+ * means the buffer can't be kept between frames: every pixel up to the
+ * last changed one is expanded again.
+ *
+ * The driver's bus, SPI or I2S, is held between frames and released in
+ * deep idle. A bit-banged strip has nothing to release.
+ */
+
+#include <errno.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/led_strip.h>
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(led_out, LOG_LEVEL_INF);
+
+#include "led_internal.h"
+
+#define STRIP_NODE DT_ALIAS(led_strip)
+
+#if DT_ON_BUS(STRIP_NODE, spi)
+#define BUS_NODE DT_BUS(STRIP_NODE)
+#elif DT_NODE_HAS_PROP(STRIP_NODE, i2s_dev)
+#define BUS_NODE DT_PHANDLE(STRIP_NODE, i2s_dev)
+#endif
+
+static const struct device *const strip = DEVICE_DT_GET(STRIP_NODE);
+
+static struct led_rgb px[STRIP_NUM_PIXELS];
+
+int led_out_init(void)
+{
+	if (!device_is_ready(strip)) {
+		LOG_ERR("LED strip device %s is not ready", strip->name);
+		return -ENODEV;
+	}
+
+	LOG_INF("Found LED strip device %s", strip->name);
+#if defined(BUS_NODE)
+	(void)pm_device_runtime_enable(DEVICE_DT_GET(BUS_NODE));
+#endif
+	return led_out_power(true);
+}
+
+void led_out_encode(const struct led_frame *f, size_t lo, size_t hi)
+{
+	ARG_UNUSED(lo);
+
+	for (size_t i = 0; i < hi; i++) {
+		px[i] = led_frame_px(f, i);
+	}
+}
+
+int led_out_send(size_t n)
+{
+	return led_strip_update_rgb(strip, px, n);
+}
+
+int led_out_power(bool on)
+{
+#if defined(BUS_NODE)
+	const struct device *bus = DEVICE_DT_GET(BUS_NODE);
+
+	return on ? pm_device_runtime_get(bus) : pm_device_runtime_put(bus);
+#else
+	ARG_UNUSED(on);
+	return 0;
+#endif
+}
@@ -0,0 +1,221 @@
+/*
+ * Per-pixel frame streaming.
+ *
+ * Writes are decoded straight from the ATT buffer into a persistent canvas
+ * of linear colors; nothing is staged in between. The canvas keeps its
+ * contents across writes, which is what makes partial and delta updates
+ * work. Setting LED_STREAM_FLAG_SHOW hands the canvas to the animation
+ * engine, which applies brightness and gamma while building the strip
+ * frame.
+ */
+
+#include <errno.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(led_stream, LOG_LEVEL_INF);
+
+#include "led_strip.h"
+#include "led_internal.h"
+
+#define PALETTE_MAX 16
+
+static struct led_rgb canvas[STRIP_NUM_PIXELS];
+static K_MUTEX_DEFINE(canvas_lock);
+
+#if defined(CONFIG_SAMPLE_LED_STREAM_STATS)
+#define STATS_WINDOW_MS 5000
+
+static int64_t stats_window;
+static uint32_t stats_frames;
+static uint32_t stats_bytes;     // all writes, shown or not
+static uint32_t stats_writes;
+
+static void stream_stats(uint16_t len, bool shown)
+{
+	int64_t now = k_uptime_get();
+
+	stats_writes++;
+	stats_bytes += len;
+	stats_frames += shown;
+
+	if (now - stats_window >= STATS_WINDOW_MS) {
+		uint32_t ms = now - stats_window;
+
+		if (stats_frames) {
+			LOG_INF("stream: %u.%u frames/s, %u bytes/frame, %u writes/frame",
+				stats_frames * 1000 / ms, (stats_frames * 10000 / ms) % 10,
+				stats_bytes / stats_frames, stats_writes / stats_frames);
+		}
+		stats_window = now;
+		stats_frames = 0;
+		stats_bytes = 0;
+		stats_writes = 0;
+	}
+}
+#else
+static inline void stream_stats(uint16_t len, bool shown) {}
+#endif /* CONFIG_SAMPLE_LED_STREAM_STATS */
+
+static inline void put_rgb(size_t i, const uint8_t *rgb)
+{
+	canvas[i].r = rgb[0];
+	canvas[i].g = rgb[1];
+	canvas[i].b = rgb[2];
+}
+
+/* [r g b]... */
+static int decode_raw(size_t pos, const uint8_t *data, size_t len)
+{
+	size_t n = len / 3;
+
+	if (len % 3 || pos + n > STRIP_NUM_PIXELS) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < n; i++, data += 3) {
+		put_rgb(pos + i, data);
+	}
+
+	return 0;
+}
+
+/* [count r g b]... */
+static int decode_rle(size_t pos, const uint8_t *data, size_t len)
+{
+	if (len % 4) {
+		return -EINVAL;
+	}
+
+	for (; len; len -= 4, data += 4) {
+		uint8_t count = data[0];
+
+		if (pos + count > STRIP_NUM_PIXELS) {
+			return -EINVAL;
+		}
+		for (; count; count--) {
+			put_rgb(pos++, &data[1]);
+		}
+	}
+
+	return 0;
+}
+
+/* [ncolors][count][ncolors x r g b][count x 4-bit index, low nibble first] */
+static int decode_palette(size_t pos, const uint8_t *data, size_t len)
+{
+	uint8_t ncolors, count;
+	const uint8_t *palette;
+	const uint8_t *idx;
+
+	if (len < 2) {
+		return -EINVAL;
+	}
+
+	ncolors = data[0];
+	count = data[1];
+	palette = &data[2];
+	idx = palette + ncolors * 3;
+
+	if (ncolors == 0 || ncolors > PALETTE_MAX ||
+	    len != 2 + ncolors * 3 + DIV_ROUND_UP(count, 2) ||
+	    pos + count > STRIP_NUM_PIXELS) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		uint8_t c = (i & 1) ? (idx[i >> 1] >> 4) : (idx[i >> 1] & 0x0F);
+
+		if (c >= ncolors) {
+			return -EINVAL;
+		}
+		put_rgb(pos + i, &palette[c * 3]);
+	}
+
+	return 0;
+}
+
+/* [skip][count][count x r g b]... applied on top of the previous frame */
+static int decode_delta(size_t pos, const uint8_t *data, size_t len)
+{
+	while (len) {
+		uint8_t count;
+
+		if (len < 2) {
+			return -EINVAL;
+		}
+
+		pos += data[0];
+		count = data[1];
+		data += 2;
+		len -= 2;
+
+		if (len < count * 3 || pos + count > STRIP_NUM_PIXELS) {
+			return -EINVAL;
+		}
+		for (; count; count--, data += 3, len -= 3) {
+			put_rgb(pos++, data);
+		}
+	}
+
+	return 0;
+}
+
+int led_stream_write(const void *buf, uint16_t len)
+{
+	const struct led_stream_hdr *hdr = buf;
+	const uint8_t *data = (const uint8_t *)buf + sizeof(*hdr);
+	size_t pos;
+	int err;
+
+	if (len < sizeof(*hdr)) {
+		return -EINVAL;
+	}
+
+	pos = sys_le16_to_cpu(hdr->offset);
+	len -= sizeof(*hdr);
+
+	k_mutex_lock(&canvas_lock, K_FOREVER);
+	switch (hdr->format) {
+	case LED_STREAM_RAW:
+		err = decode_raw(pos, data, len);
+		break;
+	case LED_STREAM_RLE:
+		err = decode_rle(pos, data, len);
+		break;
+	case LED_STREAM_PALETTE:
+		err = decode_palette(pos, data, len);
+		break;
+	case LED_STREAM_DELTA:
+		err = decode_delta(pos, data, len);
+		break;
+	default:
+		err = -ENOTSUP;
+		break;
+	}
+	k_mutex_unlock(&canvas_lock);
+
+	if (err) {
+		LOG_WRN("bad stream write (format %u, %u bytes): %d", hdr->format, len, err);
+		return err;
+	}
+
+	if (hdr->flags & LED_STREAM_FLAG_SHOW) {
+		led_anim_stream_show(led_brightness_scale(get_last_led_cmd()->brightness));
+	}
+	stream_stats(len + sizeof(*hdr), hdr->flags & LED_STREAM_FLAG_SHOW);
+
+	return 0;
+}
+
+void led_stream_render(struct led_frame *f, uint16_t scale)
+{
+	k_mutex_lock(&canvas_lock, K_FOREVER);
+	// stays a solid frame while every pixel matches the first one
+	led_frame_fill(f, led_color_gamma(led_color_dim(canvas[0], scale)));
+	for (size_t i = 1; i < STRIP_NUM_PIXELS; i++) {
+		led_frame_set(f, i, led_color_gamma(led_color_dim(canvas[i], scale)));
+	}
+	k_mutex_unlock(&canvas_lock);
+}
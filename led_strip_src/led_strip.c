@@ -16,28 +16,34 @@ LOG_MODULE_REGISTER(led_strip);
 #include <zephyr/sys/util.h>
 
 #include "led_strip.h"
+#include "led_internal.h"
+#include "led_gamma_lut.h"
+#include "src/perf_clock.h"
 
 #define STRIP_NODE		DT_ALIAS(led_strip)
 
-#if DT_NODE_HAS_PROP(DT_ALIAS(led_strip), chain_length)
-#define STRIP_NUM_PIXELS	DT_PROP(DT_ALIAS(led_strip), chain_length)
-#else
-#error Unable to determine length of LED strip
-#endif
-
-#define DELAY_TIME K_MSEC(CONFIG_SAMPLE_LED_UPDATE_DELAY)
-
 #define RGB(_r, _g, _b) { .r = (_r), .g = (_g), .b = (_b) }
 
-led_cmd_t led_cmd_data;
-
 // Declare the static variable to store last command
-static led_cmd_t last_led_cmd;
+static led_cmd_t last_led_cmd = { .brightness = LED_BRIGHTNESS_MAX };
+
+/*
+ * What each zone shows. Zone 0 is the whole strip; zone N only counts while
+ * its bit is in zone_own, otherwise it shows zone 0. Written from the FSM
+ * thread only.
+ */
+static led_cmd_t zone_cmd[LED_ZONES] = { [0] = { .brightness = LED_BRIGHTNESS_MAX } };
+static uint32_t zone_own = BIT(0);
 
-// global variables
-static int global_brightness = 100;
+/*
+ * Brightness percentage -> 8.8 fixed-point multiplier, so scaling a channel
+ * is one multiply and shift instead of a division by 100.
+ */
+#define BRIGHTNESS_SCALE(pct, _) (uint16_t)(((pct) * 256U + 50U) / 100U)
 
-static const struct device *const strip = DEVICE_DT_GET(STRIP_NODE);
+static const uint16_t brightness_lut[LED_BRIGHTNESS_MAX + 1] = {
+	LISTIFY(UTIL_INC(LED_BRIGHTNESS_MAX), BRIGHTNESS_SCALE, (,))
+};
 
 static const struct led_rgb colors[] = {
 	RGB(255, 0, 0),   /* red */
@@ -45,102 +51,308 @@ static const struct led_rgb colors[] = {
     RGB(0, 0, 255),   /* blue */
 };
 
-static struct led_rgb pixels[STRIP_NUM_PIXELS];
+// [mode][R][G][B][brightness][duration] = 6 bytes, [zone] optional
 
-int led_strip_init(void)
+/* Zone 0 is the whole strip, the devicetree children follow in order */
+#define ZONE_ENTRY(node) { .start = DT_PROP(node, start), .len = DT_PROP(node, length) },
+#define ZONE_CHECK(node)                                                         \
+	BUILD_ASSERT(DT_PROP(node, length) > 0 &&                                \
+		     DT_PROP(node, start) + DT_PROP(node, length) <= STRIP_NUM_PIXELS, \
+		     DT_NODE_FULL_NAME(node) " does not fit the LED strip");
+
+const struct led_zone led_zones[LED_ZONES] = {
+	{ .start = 0, .len = STRIP_NUM_PIXELS },
+#if DT_NODE_EXISTS(LED_ZONES_NODE)
+	DT_FOREACH_CHILD(LED_ZONES_NODE, ZONE_ENTRY)
+#endif
+};
+
+#if DT_NODE_EXISTS(LED_ZONES_NODE)
+DT_FOREACH_CHILD(LED_ZONES_NODE, ZONE_CHECK)
+#endif
+
+/*
+ * Brightness is applied first in linear space (animations blend there too),
+ * then gamma; the gamma LUT also applies the output ceiling.
+ */
+uint16_t led_brightness_scale(uint8_t brightness)
 {
-	if (!device_is_ready(strip)) {
-		LOG_ERR("LED strip device %s is not ready", strip->name);
-		return -ENODEV;
-	}
+	return brightness_lut[MIN(brightness, LED_BRIGHTNESS_MAX)];
+}
 
-	LOG_INF("Found LED strip device %s", strip->name);
-	return 0;
+struct led_rgb led_color_dim(struct led_rgb c, uint16_t scale)
+{
+	struct led_rgb color = {
+		.r = (c.r * scale) >> 8,
+		.g = (c.g * scale) >> 8,
+		.b = (c.b * scale) >> 8,
+	};
+
+	return color;
 }
 
-void led_strip_default(void)
+struct led_rgb led_color_gamma(struct led_rgb c)
 {
-	static size_t color = 0;
-	int rc;
+	struct led_rgb color = {
+		.r = led_gamma_lut[c.r],
+		.g = led_gamma_lut[c.g],
+		.b = led_gamma_lut[c.b],
+	};
 
-	for (size_t cursor = 0; cursor < ARRAY_SIZE(pixels); cursor++) {
-		memset(&pixels, 0x00, sizeof(pixels));
-		memcpy(&pixels[cursor], &colors[color], sizeof(struct led_rgb));
+	return color;
+}
 
-		rc = led_strip_update_rgb(strip, pixels, STRIP_NUM_PIXELS);
-		if (rc) {
-			LOG_ERR("couldn't update strip: %d", rc);
-		}
+#if defined(CONFIG_SAMPLE_LED_PIPELINE_BENCH)
+#define BENCH_PIXELS 1024
 
-		k_sleep(DELAY_TIME);
+// The pre-LUT implementation, kept only for comparison
+static struct led_rgb scale_rgb_div(uint8_t r, uint8_t g, uint8_t b, uint8_t brightness)
+{
+	struct led_rgb color;
+
+	color.r = (r * brightness) / 100;
+	color.g = (g * brightness) / 100;
+	color.b = (b * brightness) / 100;
+
+	return color;
+}
+
+static void led_pipeline_bench(void)
+{
+	static volatile struct led_rgb bench_px[STRIP_NUM_PIXELS]; // keeps the stores
+	uint32_t start, div_time, lut_time;
+
+	start = perf_clock_get();
+	for (size_t i = 0; i < BENCH_PIXELS; i++) {
+		bench_px[i % STRIP_NUM_PIXELS] = scale_rgb_div(i, i >> 1, i >> 2, i % 101);
 	}
+	div_time = perf_clock_get() - start;
 
-	color = (color + 1) % ARRAY_SIZE(colors);
+	start = perf_clock_get();
+	for (size_t i = 0; i < BENCH_PIXELS; i++) {
+		struct led_rgb c = RGB(i, i >> 1, i >> 2);
+
+		bench_px[i % STRIP_NUM_PIXELS] =
+			led_color_gamma(led_color_dim(c, led_brightness_scale(i % 101)));
+	}
+	lut_time = perf_clock_get() - start;
+
+	// totals, a LUT pixel takes well under a ns on a fast host
+	LOG_INF("Color pipeline (%u px): div %llu ns, lut+gamma %llu ns", BENCH_PIXELS,
+		perf_clock_to_ns(div_time), perf_clock_to_ns(lut_time));
 }
 
-// [mode][R][G][B][brightness][duration] = 6 bytes
+/* Output encoding of a solid and a per-pixel frame; runs before any transfer */
+static void led_encode_bench(void)
+{
+	static struct led_frame bench_frame;
+	uint32_t start, solid_time, px_time;
+
+	led_frame_fill(&bench_frame, (struct led_rgb)RGB(255, 160, 64));
+	start = perf_clock_get();
+	led_out_encode(&bench_frame, 0, STRIP_NUM_PIXELS);
+	solid_time = perf_clock_get() - start;
+
+	for (size_t i = 0; i < STRIP_NUM_PIXELS; i++) {
+		led_frame_set(&bench_frame, i, colors[i % ARRAY_SIZE(colors)]);
+	}
+	start = perf_clock_get();
+	led_out_encode(&bench_frame, 0, STRIP_NUM_PIXELS);
+	px_time = perf_clock_get() - start;
+
+	LOG_INF("Encode: solid %llu ns, per pixel %llu ns (%u px, %zu B/frame)",
+		perf_clock_to_ns(solid_time), perf_clock_to_ns(px_time),
+		STRIP_NUM_PIXELS, sizeof(bench_frame));
+}
+#endif /* CONFIG_SAMPLE_LED_PIPELINE_BENCH */
 
-static struct led_rgb scale_rgb(uint8_t r, uint8_t g, uint8_t b, uint8_t brightness)
+int led_strip_init(void)
 {
-	struct led_rgb color;
-	// Use global brightness instead of passed brightness
-	color.r = (r * global_brightness) / 100;
-	color.g = (g * global_brightness) / 100;
-	color.b = (b * global_brightness) / 100;
-	
-	return color;
+	int rc = led_out_init();
+
+	if (rc) {
+		return rc;
+	}
+
+#if defined(CONFIG_SAMPLE_LED_PIPELINE_BENCH)
+	led_pipeline_bench();
+	led_encode_bench();
+#endif
+	return 0;
 }
 
-void led_strip_control(const led_cmd_t *cmd)
-{	
-	int rc;
-	// Cache the command so brightness-only updates can use it
-    last_led_cmd = *cmd;  // Save the entire command
+void led_strip_default(void)
+{
+	static size_t color = 0;
 
-	// LOG_HEXDUMP_INF(cmd, sizeof(*cmd), "Command Struct:");
-	LOG_INF("Control mode: %d RGB: %02X %02X %02X Brightness: %d Duration: %d",
-		cmd->mode, cmd->r, cmd->g, cmd->b, cmd->brightness, cmd->duration);
+	// one lit pixel walking the strip, CONFIG_SAMPLE_LED_UPDATE_DELAY per step
+	led_anim_start(0, LED_MODE_CHASE, colors[color],
+		       DIV_ROUND_UP(STRIP_NUM_PIXELS * CONFIG_SAMPLE_LED_UPDATE_DELAY,
+				    LED_DURATION_UNIT_MS));
 
-	global_brightness = cmd->brightness;  // Update global brightness (0-100 range)
+	color = (color + 1) % ARRAY_SIZE(colors);
+}
 
-	struct led_rgb color;
+int led_strip_control(const led_cmd_t *cmd)
+{
+	return led_strip_control_zone(0, cmd);
+}
 
+/* The color a command paints with; -EINVAL for an unknown mode */
+static int cmd_color(const led_cmd_t *cmd, struct led_rgb *color)
+{
 	switch (cmd->mode) {
-	case 0:
+	case LED_MODE_RGB:
 		LOG_INF("Mode 0: Direct RGB control (always on)");
-		color = scale_rgb(cmd->r, cmd->g, cmd->b, cmd->brightness);
+		*color = (struct led_rgb)RGB(cmd->r, cmd->g, cmd->b);
 		break;
 
-	case 1:
+	case LED_MODE_BLINK:
+	case LED_MODE_BREATHE:
+	case LED_MODE_CHASE:
+		LOG_INF("Mode %d: animation, period %d ms", cmd->mode,
+			cmd->duration * LED_DURATION_UNIT_MS);
+		*color = (struct led_rgb)RGB(cmd->r, cmd->g, cmd->b);
+		break;
+
+	case LED_MODE_RELAX:
 		LOG_INF("Mode 1: Relax mode (warm amber)");
-		color = scale_rgb(255, 160, 64, cmd->brightness);
+		*color = (struct led_rgb)RGB(255, 160, 64);
 		break;
 
-	case 2:
+	case LED_MODE_NIGHT:
 		LOG_INF("Mode 2: Blue light night mode");
-		color = scale_rgb(0, 0, 255, cmd->brightness);
+		*color = (struct led_rgb)RGB(0, 0, 255);
 		break;
 
 	default:
 		LOG_WRN("Unsupported mode: %d", cmd->mode);
-		return -1;
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* Start the command on the zone without touching the zone state */
+static int zone_apply(uint8_t zone, const led_cmd_t *cmd)
+{
+	struct led_rgb color;
+	int rc;
+
+	// LOG_HEXDUMP_INF(cmd, sizeof(*cmd), "Command Struct:");
+	LOG_INF("Control zone %d mode: %d RGB: %02X %02X %02X Brightness: %d Duration: %d",
+		zone, cmd->mode, cmd->r, cmd->g, cmd->b, cmd->brightness, cmd->duration);
+
+	rc = cmd_color(cmd, &color);
+	if (rc) {
+		return rc;
+	}
+
+	// rendering happens on the LED work queue, this returns right away
+	uint32_t gen = led_anim_start(zone, cmd->mode,
+				      led_color_dim(color, led_brightness_scale(cmd->brightness)),
+				      cmd->duration);
+
+#if defined(CONFIG_SAMPLE_LATENCY_TRACE)
+	// the load generator encodes its sequence number in r/g/b
+	printk("trace: apply %02x%02x%02x gen %u t %llu\n", cmd->r, cmd->g, cmd->b, gen,
+	       k_ticks_to_us_floor64(k_uptime_ticks()));
+#else
+	ARG_UNUSED(gen);
+#endif
+
+	return 0;
+}
+
+/* Show every zone's own command again, zone 0 first so it does not cover them */
+static void zones_reapply(void)
+{
+	for (uint8_t z = 0; z < LED_ZONES; z++) {
+		if (zone_own & BIT(z)) {
+			(void)zone_apply(z, &zone_cmd[z]);
+		}
 	}
+	last_led_cmd = zone_cmd[0];
+}
+
+int led_strip_control_zone(uint8_t zone, const led_cmd_t *cmd)
+{
+	int rc;
 
-	// Apply color to all pixels
-	for (int i = 0; i < STRIP_NUM_PIXELS; i++) {
-		pixels[i] = color;
+	if (zone >= LED_ZONES) {
+		LOG_WRN("Unknown zone: %d", zone);
+		return -EINVAL;
 	}
 
-	// Update LED strip
-	rc = led_strip_update_rgb(strip, pixels, STRIP_NUM_PIXELS);
+	rc = zone_apply(zone, cmd);
 	if (rc) {
-		LOG_ERR("LED update failed: %d", rc);
 		return rc;
 	}
 
+	// Keep the valid command as the zone's state; capped at 100% so it
+	// holds the effective brightness
+	if (zone == 0) {
+		zone_own = BIT(0); // the whole strip replaces every zone
+	}
+	zone_own |= BIT(zone);
+	zone_cmd[zone] = *cmd;
+	zone_cmd[zone].brightness = MIN(cmd->brightness, LED_BRIGHTNESS_MAX);
+	last_led_cmd = zone_cmd[zone];
+	return 0;
+}
+
+bool led_strip_zone_get(uint8_t zone, led_cmd_t *cmd)
+{
+	if (zone >= LED_ZONES || !(zone_own & BIT(zone))) {
+		return false;
+	}
+	*cmd = zone_cmd[zone];
+	return true;
+}
+
+uint8_t led_strip_step_brightness(int delta)
+{
+	for (uint8_t z = 0; z < LED_ZONES; z++) {
+		zone_cmd[z].brightness = CLAMP(zone_cmd[z].brightness + delta, 0,
+					       LED_BRIGHTNESS_MAX);
+	}
+	zones_reapply();
+	return zone_cmd[0].brightness;
+}
+
+int led_strip_set_mode(uint8_t mode)
+{
+	led_cmd_t probe = { .mode = mode };
+	struct led_rgb color;
+
+	if (cmd_color(&probe, &color)) {
+		return -EINVAL;
+	}
+
+	// colors and brightness stay, the change is instant
+	for (uint8_t z = 0; z < LED_ZONES; z++) {
+		led_cmd_t *c = &zone_cmd[z];
+
+		c->mode = mode;
+		c->duration = 0;
+		if (mode == LED_MODE_RGB && !(c->r | c->g | c->b)) {
+			c->r = 255; // never had a color: red, so the tap shows
+		}
+	}
+	zones_reapply();
 	return 0;
 }
 
+bool led_strip_dark(void)
+{
+	return !led_anim_busy() && led_frame_dark();
+}
+
+int led_strip_power(bool on)
+{
+	return led_out_power(on);
+}
+
 // Add a getter function to retrieve the last command
 const led_cmd_t* get_last_led_cmd(void) {
     return &last_led_cmd;
@@ -1,34 +1,145 @@
 #pragma once
 
 #include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/sys/util.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/** Brightness is a percentage everywhere in the app */
+#define LED_BRIGHTNESS_MAX 100
+
+/** Modes carried in led_cmd_t.mode */
+enum led_mode {
+	LED_MODE_RGB = 0,      // solid r/g/b, fades in over duration
+	LED_MODE_RELAX = 1,    // solid warm amber, fades in over duration
+	LED_MODE_NIGHT = 2,    // solid blue, fades in over duration
+	LED_MODE_BLINK = 3,    // r/g/b on/off, duration is the period
+	LED_MODE_BREATHE = 4,  // r/g/b ramping up and down, duration is the period
+	LED_MODE_CHASE = 5,    // one r/g/b pixel walking the strip, duration is one lap
+};
+
+/** led_cmd_t.duration is counted in these */
+#define LED_DURATION_UNIT_MS 50
+
+/**
+ * LED zones. Zone 0 is the whole strip, zone N the N-th child of the
+ * "app,led-zones" devicetree node, if the board has one.
+ */
+#define LED_ZONES_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(app_led_zones)
+#if DT_NODE_EXISTS(LED_ZONES_NODE)
+#define LED_ZONES (1 + DT_CHILD_NUM(LED_ZONES_NODE))
+#else
+#define LED_ZONES 1
+#endif
+
 /** LED command format from BLE write */
 typedef struct __packed {
 	uint8_t mode;        // 0–5
 	uint8_t r;
 	uint8_t g;
 	uint8_t b;     
-	uint8_t brightness;  // 0–100%
-	uint8_t duration;    // 1–250 (unit: 50ms)
+	uint8_t brightness;  // 0–100%, larger values are capped
+	uint8_t duration;    // 0–255 (unit: 50ms), 0 = instant / default period
 } led_cmd_t;
 
+/** Pixel stream encodings, see instruction.md */
+enum led_stream_format {
+	LED_STREAM_RAW = 0,      // r g b per pixel
+	LED_STREAM_RLE = 1,      // runs of count r g b
+	LED_STREAM_PALETTE = 2,  // up to 16 colors and 4-bit indices
+	LED_STREAM_DELTA = 3,    // skip/count spans over the previous frame
+};
+
+/** Show the canvas once this write is decoded */
+#define LED_STREAM_FLAG_SHOW BIT(0)
+
+/** Header of every stream write, followed by the encoded pixels */
+struct led_stream_hdr {
+	uint8_t format;   // enum led_stream_format
+	uint8_t flags;    // LED_STREAM_FLAG_*
+	uint16_t offset;  // first pixel written, little endian
+} __packed;
+
 /** Initialize LED strip (configure device, check ready state) */
 int led_strip_init(void);
 
-/** Run LED animation in a loop */
+/** Start the demo chase, cycling its color on every call */
 void led_strip_default(void);
 
-/** Control LED strip once based on command data */
-void led_strip_control(const led_cmd_t *cmd);
+/** Apply command data to the whole strip; animations run in the background */
+int led_strip_control(const led_cmd_t *cmd);
 
-/* Global LED brightness */
+/**
+ * Apply command data to one zone. Only that zone's pixels are re-rendered
+ * and sent; zone 0 replaces every zone. Returns -EINVAL for an unknown zone.
+ */
+int led_strip_control_zone(uint8_t zone, const led_cmd_t *cmd);
+
+/** Last command applied to any zone, for reporting; see led_strip_zone_get() */
 const led_cmd_t* get_last_led_cmd(void);
 
+/**
+ * Copy the command zone @p zone shows. Returns false for an unknown zone
+ * or one that shows zone 0 because it has no command of its own.
+ */
+bool led_strip_zone_get(uint8_t zone, led_cmd_t *cmd);
+
+/**
+ * Change every zone's brightness by @p delta percent, keeping its mode and
+ * color, and show the result. Returns zone 0's new brightness.
+ */
+uint8_t led_strip_step_brightness(int delta);
+
+/**
+ * Switch every zone to @p mode at once, keeping its color and brightness.
+ * Returns -EINVAL for an unknown mode.
+ */
+int led_strip_set_mode(uint8_t mode);
+
+/** Called from the LED render work queue when the last animation ends */
+typedef void (*led_strip_idle_cb_t)(void);
+
+/** Register the idle callback; check led_strip_dark() from there on */
+void led_strip_set_idle_cb(led_strip_idle_cb_t cb);
+
+/** Frame events for the application's instrumentation */
+enum led_strip_event {
+	LED_STRIP_FRAME_PUSHED,   // a frame was handed to the tx queue
+	LED_STRIP_FRAME_SENT,     // a transfer that began at @p start completed
+	LED_STRIP_FIRST_PIXELS,   // an animation started at @p start is on the strip
+};
+
+/**
+ * Called from the LED work queues, LED_STRIP_FIRST_PIXELS with a spinlock
+ * held, so keep it short. @p start is a k_cycle_get_32() stamp, 0 for
+ * LED_STRIP_FRAME_PUSHED.
+ */
+typedef void (*led_strip_event_cb_t)(enum led_strip_event evt, uint32_t start);
+
+/** Register the frame event callback, NULL to stop reporting */
+void led_strip_set_event_cb(led_strip_event_cb_t cb);
+
+/** Every pixel off, nothing animating and no frame waiting to go out */
+bool led_strip_dark(void);
+
+/**
+ * Release the output bus while the strip is dark (@p on false), or take
+ * it back before the next frame. Uses device runtime PM; a no-op for
+ * buses without it.
+ */
+int led_strip_power(bool on);
+
+/**
+ * Decode one stream write into the pixel canvas. Safe to call from the
+ * BT RX thread; returns -EINVAL on malformed data.
+ */
+int led_stream_write(const void *buf, uint16_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,40 +1,194 @@
 #include <zephyr/kernel.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/sys/printk.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/spsc_lockfree.h>
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
 #include "motor.h"
-#include <stdio.h>
+
+#if defined(CONFIG_SAMPLE_TAP_EMUL)
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#endif
 
 #define ZEPHYR_USER_NODE DT_PATH(zephyr_user)
 
 const struct gpio_dt_spec signal = GPIO_DT_SPEC_GET(ZEPHYR_USER_NODE, signal_gpios);
 
-int vibration_count = 0; 
-
-int motor_on(void)
-{
-    /* Configure the pin */
-    gpio_pin_configure_dt(&signal, GPIO_INPUT | signal.dt_flags);
-    
-
-    /* Set the pin to its active level */
-    gpio_pin_set_dt(&signal, 1);
-
-    // read pin
-    int val = gpio_pin_get_dt(&signal);
-    if (val == 0) {
-        k_sleep(K_MSEC(2));
-        if (val == 0){
-            vibration_count++;
-            // printk("RUNG OK [%d]\n", vibration_count);
-            // prevent repeated count on same event
-            while (gpio_pin_get_dt(&signal) == 0) {
-                k_sleep(K_MSEC(1));              // Wait until signal released
-            }
-
-            return 1;
-        }
-    }
-    return 0;
-}
\ No newline at end of file
+#define DEBOUNCE_TIME K_MSEC(CONFIG_SAMPLE_TAP_DEBOUNCE_MS)
+
+/*
+ * Taps are produced by the GPIO ISR and consumed by the sensor thread, so
+ * a single-producer/single-consumer ring needs no locking.
+ */
+SPSC_DEFINE(tap_ring, struct tap_event, CONFIG_SAMPLE_TAP_RING_SIZE);
+
+#define TAP_BATCH 8
+
+static K_SEM_DEFINE(tap_sem, 0, 1);
+
+static struct gpio_callback signal_cb_data;
+static struct k_timer debounce_timer;
+static motor_tap_cb_t tap_cb;
+static bool armed;
+
+static uint32_t tap_seq;       // written by ISR only
+static atomic_t tap_dropped;
+
+static void tap_record(void)
+{
+	struct tap_event *evt = spsc_acquire(&tap_ring);
+
+	tap_seq++;
+	if (evt == NULL) {
+		atomic_inc(&tap_dropped);
+	} else {
+		evt->timestamp = k_cycle_get_32();
+		evt->seq = tap_seq;
+		spsc_produce(&tap_ring);
+	}
+
+	k_sem_give(&tap_sem);
+}
+
+static void tap_start_debounce(void)
+{
+	// ignore bounces until the line has settled
+	gpio_pin_interrupt_configure_dt(&signal, GPIO_INT_DISABLE);
+	k_timer_start(&debounce_timer, DEBOUNCE_TIME, K_NO_WAIT);
+}
+
+static void signal_isr(const struct device *dev, struct gpio_callback *cb,
+		       uint32_t pins)
+{
+	tap_record();
+	tap_start_debounce();
+}
+
+/*
+ * Taps are recorded by the GPIO ISR only, so the ring keeps a single
+ * producer. The line is sampled and the edge re-armed with interrupts
+ * locked: the ISR can't run in between, and an edge after arming is
+ * latched and delivered once the lock is released.
+ */
+static void debounce_expired(struct k_timer *timer)
+{
+	unsigned int key = irq_lock();
+
+	if (gpio_pin_get_dt(&signal) == 0) {
+		// signal still held: check again later instead of blocking anyone
+		k_timer_start(&debounce_timer, DEBOUNCE_TIME, K_NO_WAIT);
+	} else {
+		gpio_pin_interrupt_configure_dt(&signal, GPIO_INT_EDGE_TO_INACTIVE);
+	}
+	irq_unlock(key);
+}
+
+/* Move up to max queued taps into events, oldest first */
+static size_t tap_drain(struct tap_event *events, size_t max)
+{
+	size_t n = 0;
+
+	while (n < max) {
+		struct tap_event *evt = spsc_consume(&tap_ring);
+
+		if (evt == NULL) {
+			break;
+		}
+		events[n++] = *evt;
+		spsc_release(&tap_ring);
+	}
+
+	return n;
+}
+
+/* Hands taps to the application in batches, off the ISR and the FSM thread */
+static void sensor_thread(void *p1, void *p2, void *p3)
+{
+	struct tap_event taps[TAP_BATCH];
+	size_t n;
+
+	for (;;) {
+		k_sem_take(&tap_sem, K_FOREVER);
+
+		while ((n = tap_drain(taps, ARRAY_SIZE(taps))) > 0) {
+			tap_cb(taps, n);
+		}
+	}
+}
+
+K_THREAD_DEFINE(sensor_tid, CONFIG_SAMPLE_SENSOR_STACK_SIZE, sensor_thread,
+		NULL, NULL, NULL, CONFIG_SAMPLE_SENSOR_PRIORITY, 0, SYS_FOREVER_MS);
+
+int motor_init(motor_tap_cb_t cb)
+{
+	int err;
+
+	if (!gpio_is_ready_dt(&signal)) {
+		printk("Vibration sensor GPIO not ready\n");
+		return -ENODEV;
+	}
+
+	/* Configure the pin once; taps are reported by interrupt */
+	err = gpio_pin_configure_dt(&signal, GPIO_INPUT);
+	if (err) {
+		return err;
+	}
+
+	tap_cb = cb;
+	k_thread_name_set(sensor_tid, "sensor");
+	k_thread_start(sensor_tid);
+	k_timer_init(&debounce_timer, debounce_expired, NULL);
+
+	gpio_init_callback(&signal_cb_data, signal_isr, BIT(signal.pin));
+	err = gpio_add_callback_dt(&signal, &signal_cb_data);
+	if (err) {
+		return err;
+	}
+
+	err = gpio_pin_interrupt_configure_dt(&signal, GPIO_INT_EDGE_TO_INACTIVE);
+	if (err) {
+		return err;
+	}
+
+	armed = true;
+	return 0;
+}
+
+bool motor_is_armed(void)
+{
+	return armed;
+}
+
+uint32_t motor_tap_dropped(void)
+{
+	return (uint32_t)atomic_get(&tap_dropped);
+}
+
+#if defined(CONFIG_SAMPLE_TAP_EMUL)
+/*
+ * Drive the emulated signal pin with a tap every
+ * CONFIG_SAMPLE_TAP_EMUL_PERIOD_MS and compare against what was captured.
+ */
+static uint32_t emul_generated;
+
+static void tap_emul_fn(struct k_timer *timer)
+{
+	gpio_emul_input_set(signal.port, signal.pin, 0);
+	gpio_emul_input_set(signal.port, signal.pin, 1);
+
+	if (++emul_generated % 1000 == 0) {
+		printk("Tap emul: generated %u captured %u dropped %u\n",
+		       emul_generated, tap_seq, motor_tap_dropped());
+	}
+}
+
+static K_TIMER_DEFINE(tap_emul_timer, tap_emul_fn, NULL);
+
+void motor_emul_start(void)
+{
+	gpio_emul_input_set(signal.port, signal.pin, 1);
+	k_timer_start(&tap_emul_timer, K_MSEC(CONFIG_SAMPLE_TAP_EMUL_PERIOD_MS),
+		      K_MSEC(CONFIG_SAMPLE_TAP_EMUL_PERIOD_MS));
+}
+#endif /* CONFIG_SAMPLE_TAP_EMUL */
@@ -3,18 +3,42 @@
 
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern int vibration_count;
+/** One debounced tap from the SW1801P sensor */
+struct tap_event {
+	uint32_t timestamp;  // hardware cycle count at the edge
+	uint32_t seq;        // running tap number, gaps mean dropped taps
+};
 
-/** @brief Detect vibration and update count */
-int motor_on(void);
+/**
+ * Called from the sensor thread with up to 8 taps, oldest first. The
+ * thread blocks while it runs, so taps keep queueing in the ring.
+ */
+typedef void (*motor_tap_cb_t)(const struct tap_event *taps, size_t n);
+
+/** @brief Start the sensor thread and arm the vibration sensor interrupt */
+int motor_init(motor_tap_cb_t cb);
+
+/** @brief True once the sensor interrupt is armed */
+bool motor_is_armed(void);
+
+/** @brief Number of taps lost because the ring was full */
+uint32_t motor_tap_dropped(void);
+
+#if defined(CONFIG_SAMPLE_TAP_EMUL)
+/** @brief Start generating taps on the emulated signal pin */
+void motor_emul_start(void);
+#endif
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif // MOTOR_H
\ No newline at end of file
+#endif // MOTOR_H
@@ -0,0 +1,327 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""End-to-end BLE load test in BabbleSim.
+
+Builds the firmware (with CONFIG_SAMPLE_LATENCY_TRACE) and the load
+generator in tools/bsim_loadgen for nrf52_bsim. It then runs --units
+firmware devices against --phones generators on a simulated 2.4 GHz
+channel and writes a JSON report:
+
+  * write-to-pixel latency percentiles for LED writes: from the phone
+    starting the write to the first frame for it reaching the strip
+  * LED writes overwritten by a later writer (accepted, never shown)
+  * writes rejected with an ATT error, and generator backpressure
+  * accepted commands per second
+  * the FSM's wakeups per second, busy and idle, and its write-to-dispatch
+    latency (CONFIG_SAMPLE_FSM_STATS); --poll-baseline builds the 10 ms
+    polling loop instead, to compare against
+  * with --dfu, the SMP image upload run next to the load: bytes
+    acknowledged and KB/s, from the generator and from the firmware
+  * with --units 2 or more, a group sync check: the firmware is built with
+    group_sync.conf, and every LED write must reach the strip of every
+    unit within --max-skew-us of the first one (exit status 1 otherwise)
+
+    BSIM_OUT_PATH=... scripts/bsim_load.py --phones 2 --rate 100 -o run.json
+    scripts/bsim_load.py --compare base.json run.json
+    scripts/bsim_load.py --poll-baseline -o poll.json
+    scripts/bsim_load.py --dfu 128 -o dfu.json   # firmware built with dfu.conf
+    scripts/bsim_load.py --units 2 --rate 5 -o sync.json
+"""
+
+import argparse
+import json
+import os
+import pathlib
+import re
+import subprocess
+import sys
+
+APP_DIR = pathlib.Path(__file__).resolve().parent.parent
+LOADGEN_DIR = APP_DIR / "tools" / "bsim_loadgen"
+BOARD = "nrf52_bsim"
+
+# bsim prefixes device output with "d_NN: @HH:MM:SS.uuuuuu  "
+PREFIX = r"(?:d_\d+: @[\d:.]+\s+)?"
+RE_TX = re.compile(PREFIX + r"lg: tx (\d+) (\w+) t (\d+)")
+RE_RSP = re.compile(PREFIX + r"lg: rsp (\d+) err (\d+) t (\d+)")
+RE_DONE = re.compile(PREFIX + r"lg: done sent (\d+) ok (\d+) err (\d+) backpressure (\d+)")
+RE_APPLY = re.compile(PREFIX + r"trace: apply ([0-9a-f]{6}) gen (\d+) t (\d+)")
+RE_PX = re.compile(PREFIX + r"trace: px gen (\d+) t (\d+)")
+RE_DFU_START = re.compile(PREFIX + r"lg: dfu start bytes (\d+) t (\d+)")
+RE_DFU_DONE = re.compile(PREFIX + r"lg: dfu done bytes (\d+) rc (-?\d+) t (\d+)")
+RE_FSM = re.compile(r"FSM: (\d+) wakeups/s, write-to-dispatch avg (\d+) us max (\d+) us "
+                    r"\((\d+) cmds\)")
+RE_FW_DFU = re.compile(r"dfu: (done|stopped) (\d+)/(\d+) B in (\d+) ms, ([\d.]+) KB/s")
+
+
+def build(app, build_dir, extra):
+    cmd = ["west", "build", "-p", "auto", "-b", BOARD, "-d", str(build_dir), str(app), "--"]
+    subprocess.run(cmd + extra, check=True, stdout=subprocess.DEVNULL)
+    return build_dir / "zephyr" / "zephyr.exe"
+
+
+def run(args, fw_exe, lg_exe):
+    bsim_bin = pathlib.Path(os.environ["BSIM_OUT_PATH"]) / "bin"
+    sim_id = f"slb_load_{os.getpid()}"
+    devices = args.units + args.phones
+    # room for an upload that outlasts the load, down to 4 KB/s
+    sim_us = (args.duration + 5 + args.dfu // 4) * 1_000_000
+
+    procs = [subprocess.Popen([str(bsim_bin / "bs_2G4_phy_v1"), f"-s={sim_id}",
+                               f"-D={devices}", f"-sim_length={sim_us}"],
+                              cwd=bsim_bin, stdout=subprocess.DEVNULL)]
+    outs = []
+    for d in range(devices):
+        exe = fw_exe if d < args.units else lg_exe
+        p = subprocess.Popen([str(exe), f"-s={sim_id}", f"-d={d}", "-rs=" + str(d + 1)],
+                             cwd=bsim_bin, stdout=subprocess.PIPE, text=True)
+        procs.append(p)
+        outs.append(p)
+
+    logs = [p.communicate()[0] for p in outs]
+    procs[0].wait()
+    return logs
+
+
+def percentile(values, pct):
+    if not values:
+        return None
+    values = sorted(values)
+    k = min(len(values) - 1, round(pct / 100 * (len(values) - 1)))
+    return values[k]
+
+
+def analyse_dfu(fw_log, lg_logs):
+    start = done = None
+    for log in lg_logs:
+        for line in log.splitlines():
+            if m := RE_DFU_START.match(line):
+                start = int(m[2])
+            elif m := RE_DFU_DONE.match(line):
+                done = (int(m[1]), int(m[2]), int(m[3]))
+    if done is None:
+        return None
+
+    acked, rc, t_done = done
+    dfu = {"bytes": acked, "rc": rc}
+    if start is not None and t_done > start:
+        dfu["seconds"] = round((t_done - start) / 1e6, 2)
+        dfu["kb_per_s"] = round(acked / 1024 / ((t_done - start) / 1e6), 1)
+    for line in fw_log.splitlines():
+        if m := RE_FW_DFU.search(line):
+            dfu["firmware"] = {"result": m[1], "bytes": int(m[2]), "ms": int(m[4]),
+                               "kb_per_s": float(m[5])}
+    return dfu
+
+
+def analyse_fsm(fw_log):
+    """Folds the per-second FSM reports; reports without commands are idle."""
+    reports = [tuple(int(x) for x in m.groups()) for m in RE_FSM.finditer(fw_log)]
+    if not reports:
+        return None
+
+    busy = [r for r in reports if r[3]]
+    idle = [r[0] for r in reports if not r[3]]
+    cmds = sum(r[3] for r in busy)
+    return {
+        "cmds": cmds,
+        "wakeups_per_s": round(sum(r[0] for r in busy) / len(busy), 1) if busy else None,
+        "idle_wakeups_per_s": round(sum(idle) / len(idle), 1) if idle else None,
+        "dispatch_us": {
+            "mean": round(sum(r[1] * r[3] for r in busy) / cmds) if cmds else None,
+            "max": max(r[2] for r in busy) if busy else None,
+        },
+    }
+
+
+def unit_traces(fw_log):
+    """Command tag -> generation applied, and generation -> first pixel time."""
+    apply_gen, shown = {}, {}
+    for line in fw_log.splitlines():
+        if m := RE_APPLY.match(line):
+            apply_gen[int(m[1], 16)] = int(m[2])
+        elif m := RE_PX.match(line):
+            shown.setdefault(int(m[1]), int(m[2]))
+    return apply_gen, shown
+
+
+def pixel_times(fw_logs):
+    """Command tag -> time its first frame reached each unit's strip, per unit."""
+    times = []
+    for fw_log in fw_logs:
+        apply_gen, shown = unit_traces(fw_log)
+        times.append({tag: shown[gen] for tag, gen in apply_gen.items() if gen in shown})
+    return times
+
+
+def analyse_sync(times, max_skew_us):
+    """Spread of the pixel times of each command across all units."""
+    tags = set().union(*times)
+    everywhere = [tag for tag in tags if all(tag in t for t in times)]
+    skews = [max(t[tag] for t in times) - min(t[tag] for t in times) for tag in everywhere]
+
+    skew = {f"p{p}": percentile(skews, p) for p in (50, 90, 99)}
+    skew["max"] = max(skews) if skews else None
+    return {
+        "units": len(times),
+        "commands": len(tags),
+        "on_every_unit": len(everywhere),
+        "skew_us": skew,
+        "max_skew_us": max_skew_us,
+        "pass": bool(skews) and len(everywhere) == len(tags) and max(skews) <= max_skew_us,
+    }
+
+
+def analyse(fw_logs, lg_logs, duration, max_skew_us):
+    tx, rsp = {}, {}
+    totals = {"sent": 0, "ok": 0, "err": 0, "backpressure": 0}
+    for log in lg_logs:
+        for line in log.splitlines():
+            if m := RE_TX.match(line):
+                tx[int(m[1])] = (m[2], int(m[3]))
+            elif m := RE_RSP.match(line):
+                rsp[int(m[1])] = (int(m[2]), int(m[3]))
+            elif m := RE_DONE.match(line):
+                for key, val in zip(totals, m.groups()):
+                    totals[key] += int(val)
+
+    # phones may have picked any unit; the first strip to show a write counts
+    times = pixel_times(fw_logs)
+
+    latencies = []
+    overwritten = 0
+    led_ok = 0
+    for seq, (op, t_tx) in tx.items():
+        if op != "led" or rsp.get(seq, (1,))[0] != 0:
+            continue
+        led_ok += 1
+        shown = [t[seq & 0xFFFFFF] for t in times if seq & 0xFFFFFF in t]
+        if not shown:
+            overwritten += 1  # accepted, but a later write won
+            continue
+        latencies.append(min(shown) - t_tx)
+
+    lat = {f"p{p}": percentile(latencies, p) for p in (50, 90, 99)}
+    lat["max"] = max(latencies) if latencies else None
+    lat["mean"] = round(sum(latencies) / len(latencies)) if latencies else None
+
+    result = {
+        "writes": totals,
+        "rejected": sum(1 for err, _ in rsp.values() if err),
+        "led": {
+            "accepted": led_ok,
+            "shown": len(latencies),
+            "overwritten": overwritten,
+            "latency_us": lat,
+        },
+        "throughput_cmds_per_s": round(totals["ok"] / duration, 1),
+    }
+    if (fsm := analyse_fsm(fw_logs[0])) is not None:
+        result["fsm"] = fsm
+    if (dfu := analyse_dfu(fw_logs[0], lg_logs)) is not None:
+        result["dfu"] = dfu
+    if len(fw_logs) > 1:
+        result["group_sync"] = analyse_sync(times, max_skew_us)
+    return result
+
+
+def compare(base_path, new_path):
+    base = json.loads(pathlib.Path(base_path).read_text())
+    new = json.loads(pathlib.Path(new_path).read_text())
+
+    def flat(d, prefix=""):
+        for k, v in d.items():
+            if isinstance(v, dict):
+                yield from flat(v, f"{prefix}{k}.")
+            elif isinstance(v, (int, float)):
+                yield f"{prefix}{k}", v
+
+    b = dict(flat(base["result"]))
+    print(f"{'metric':40} {'base':>12} {'new':>12} {'delta':>10}")
+    for key, val in flat(new["result"]):
+        old = b.get(key)
+        delta = "" if old in (None, 0) else f"{(val - old) / old * 100:+.1f}%"
+        print(f"{key:40} {str(old):>12} {val:>12} {delta:>10}")
+
+
+def git_describe():
+    try:
+        return subprocess.run(["git", "describe", "--always", "--dirty"], cwd=APP_DIR,
+                              capture_output=True, text=True, check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--units", type=int, default=1,
+                        help="firmware devices; 2 or more adds the group sync check")
+    parser.add_argument("--max-skew-us", type=int, default=10000,
+                        help="group sync check: largest pixel time spread across units")
+    parser.add_argument("--phones", type=int, default=1, help="simulated phones")
+    parser.add_argument("--rate", type=int, default=50, help="writes/s per phone")
+    parser.add_argument("--mix", default="80:10:10", help="led:motor:cfg percent")
+    parser.add_argument("--duration", type=int, default=10, help="seconds of load")
+    parser.add_argument("--dfu", type=int, default=0, metavar="KB",
+                        help="also upload an image of this size over SMP")
+    parser.add_argument("--dfu-window", type=int, default=3,
+                        help="SMP upload requests in flight")
+    parser.add_argument("--poll-baseline", action="store_true",
+                        help="build the firmware with CONFIG_SAMPLE_FSM_POLL_BASELINE")
+    parser.add_argument("--build-dir", type=pathlib.Path, default=pathlib.Path("build-bsim"))
+    parser.add_argument("-o", "--output", type=pathlib.Path, default=pathlib.Path("load.json"))
+    parser.add_argument("--compare", nargs=2, metavar=("BASE", "NEW"),
+                        help="diff two reports instead of running")
+    args = parser.parse_args()
+
+    if args.compare:
+        compare(*args.compare)
+        return
+
+    if "BSIM_OUT_PATH" not in os.environ:
+        sys.exit("BSIM_OUT_PATH is not set")
+
+    led, motor, cfg = (int(x) for x in args.mix.split(":"))
+    if led + motor + cfg != 100:
+        sys.exit("--mix must add up to 100")
+
+    if args.units > 1 and args.dfu:
+        sys.exit("--dfu runs against a single unit")
+
+    # one FSM report per second, so the idle tail after the load shows up
+    fw_extra = ["-DCONFIG_SAMPLE_LATENCY_TRACE=y", "-DCONFIG_SAMPLE_FSM_STATS_INTERVAL=1"]
+    if args.poll_baseline:
+        fw_extra.append("-DCONFIG_SAMPLE_FSM_POLL_BASELINE=y")
+    lg_extra = [f"-DCONFIG_LOADGEN_RATE_HZ={args.rate}",
+                f"-DCONFIG_LOADGEN_MIX_LED={led}",
+                f"-DCONFIG_LOADGEN_MIX_MOTOR={motor}",
+                f"-DCONFIG_LOADGEN_DURATION_S={args.duration}"]
+    if args.units > 1:
+        fw_extra.append("-DEXTRA_CONF_FILE=group_sync.conf")
+    if args.dfu:
+        fw_extra.append("-DEXTRA_CONF_FILE=dfu.conf")
+        lg_extra += [f"-DCONFIG_LOADGEN_DFU_KB={args.dfu}",
+                     f"-DCONFIG_LOADGEN_DFU_WINDOW={args.dfu_window}"]
+
+    fw_exe = build(APP_DIR, args.build_dir / "firmware", fw_extra)
+    lg_exe = build(LOADGEN_DIR, args.build_dir / "loadgen", lg_extra)
+
+    logs = run(args, fw_exe, lg_exe)
+    fw_logs, lg_logs = logs[:args.units], logs[args.units:]
+    report = {
+        "image": git_describe(),
+        "config": {"units": args.units, "phones": args.phones, "rate_hz": args.rate,
+                   "mix": args.mix,
+                   "duration_s": args.duration, "dfu_kb": args.dfu,
+                   "dfu_window": args.dfu_window, "poll_baseline": args.poll_baseline},
+        "result": analyse(fw_logs, lg_logs, args.duration, args.max_skew_us),
+    }
+    args.output.write_text(json.dumps(report, indent=2) + "\n")
+    print(json.dumps(report["result"], indent=2))
+    if not report["result"].get("group_sync", {}).get("pass", True):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""Measure the RAM cost of each extra BLE connection.
+
+Builds the sample with two CONFIG_BT_MAX_CONN values and compares the
+static RAM (data + bss + noinit) of the resulting images. The difference
+covers the host, controller and app state that scales with the number of
+connections, which the boot log cannot see:
+
+    scripts/conn_ram.py -b nrf52dk/nrf52832 --conns 1 4
+"""
+
+import argparse
+import pathlib
+import subprocess
+import sys
+
+RAM_SECTIONS = (".data", ".bss", ".noinit")
+
+
+def build(board, conns, build_dir, app_dir):
+    subprocess.run(["west", "build", "-p", "auto", "-b", board, "-d", str(build_dir),
+                    str(app_dir), "--", f"-DCONFIG_BT_MAX_CONN={conns}"],
+                   check=True, stdout=subprocess.DEVNULL)
+    return build_dir / "zephyr" / "zephyr.elf"
+
+
+def ram_bytes(elf):
+    out = subprocess.run(["arm-none-eabi-size", "-A", str(elf)], check=True,
+                         capture_output=True, text=True).stdout
+    total = 0
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[0].startswith(RAM_SECTIONS):
+            total += int(fields[1])
+    return total
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-b", "--board", default="nrf52dk/nrf52832")
+    parser.add_argument("--conns", type=int, nargs=2, default=[1, 4],
+                        metavar=("LOW", "HIGH"))
+    parser.add_argument("--build-dir", type=pathlib.Path, default=pathlib.Path("build-conn"))
+    args = parser.parse_args()
+
+    low, high = args.conns
+    if high <= low:
+        sys.exit("HIGH must be greater than LOW")
+
+    app_dir = pathlib.Path(__file__).resolve().parent.parent
+    ram = {}
+    for conns in (low, high):
+        elf = build(args.board, conns, args.build_dir / f"conn{conns}", app_dir)
+        ram[conns] = ram_bytes(elf)
+        print(f"{conns} connection(s): {ram[conns]} B static RAM")
+
+    print(f"per extra connection: {(ram[high] - ram[low]) / (high - low):.0f} B")
+
+
+if __name__ == "__main__":
+    main()
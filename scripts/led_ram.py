@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""Measure static RAM against LED strip length.
+
+Builds the sample for each chain length with the default LED output (Zephyr
+ws2812-spi driver, RGB frames) and with led_lean.conf (built-in SPI
+encoder, palette frames), then prints static RAM and bytes per pixel. The
+chain length is overridden with a generated devicetree overlay:
+
+    scripts/led_ram.py -b nrf52dk/nrf52832 --pixels 16 300
+"""
+
+import argparse
+import pathlib
+import subprocess
+
+from conn_ram import ram_bytes
+
+APP_DIR = pathlib.Path(__file__).resolve().parent.parent
+VARIANTS = {
+    "driver": [],
+    "lean": ["-DEXTRA_CONF_FILE=led_lean.conf"],
+}
+
+
+def build(board, pixels, variant, build_dir):
+    overlay = build_dir / "chain.overlay"
+    build_dir.mkdir(parents=True, exist_ok=True)
+    overlay.write_text(f"&led_strip {{ chain-length = <{pixels}>; }};\n")
+    subprocess.run(["west", "build", "-p", "auto", "-b", board, "-d", str(build_dir),
+                    str(APP_DIR), "--", f"-DEXTRA_DTC_OVERLAY_FILE={overlay.resolve()}",
+                    *VARIANTS[variant]],
+                   check=True, stdout=subprocess.DEVNULL)
+    return build_dir / "zephyr" / "zephyr.elf"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-b", "--board", default="nrf52dk/nrf52832")
+    parser.add_argument("--pixels", type=int, nargs=2, default=[16, 300],
+                        metavar=("LOW", "HIGH"))
+    parser.add_argument("--build-dir", type=pathlib.Path, default=pathlib.Path("build-led"))
+    args = parser.parse_args()
+
+    low, high = args.pixels
+    for variant in VARIANTS:
+        ram = {}
+        for pixels in (low, high):
+            elf = build(args.board, pixels, variant, args.build_dir / f"{variant}{pixels}")
+            ram[pixels] = ram_bytes(elf)
+            print(f"{variant:6} {pixels:4} px: {ram[pixels]} B static RAM")
+        print(f"{variant:6} per pixel: {(ram[high] - ram[low]) / (high - low):.1f} B")
+
+
+if __name__ == "__main__":
+    main()
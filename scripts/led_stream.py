@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""Reference encoder for the Pixel Stream characteristic.
+
+Encodes test frames in every stream format, checks them against a
+reference decoder that mirrors led_stream.c, and reports bytes per frame,
+writes per frame and the frame rate a link can sustain:
+
+    scripts/led_stream.py --pixels 16 64 300 --mtu 247 --interval-ms 15
+"""
+
+import argparse
+import colorsys
+import struct
+
+RAW, RLE, PALETTE, DELTA = range(4)
+FLAG_SHOW = 0x01
+HDR = struct.Struct("<BBH")
+PALETTE_MAX = 16
+
+
+def write(fmt, offset, payload, show):
+    return HDR.pack(fmt, FLAG_SHOW if show else 0, offset) + bytes(payload)
+
+
+def chunk(units, room):
+    """Split a list of encoded units (bytes, pixel count) into writes."""
+    out, cur, cur_px, start = [], b"", 0, 0
+    for data, px in units:
+        if cur and len(cur) + len(data) > room:
+            out.append((start, cur))
+            start, cur, cur_px = start + cur_px, b"", 0
+        cur += data
+        cur_px += px
+    if cur:
+        out.append((start, cur))
+    return out
+
+
+def encode_raw(frame, prev, room):
+    units = [(bytes(p), 1) for p in frame]
+    return [(RAW, off, data) for off, data in chunk(units, room)]
+
+
+def encode_rle(frame, prev, room):
+    units, i = [], 0
+    while i < len(frame):
+        n = 1
+        while i + n < len(frame) and n < 255 and frame[i + n] == frame[i]:
+            n += 1
+        units.append((bytes([n, *frame[i]]), n))
+        i += n
+    return [(RLE, off, data) for off, data in chunk(units, room)]
+
+
+def encode_palette(frame, prev, room):
+    colors = sorted(set(frame))
+    if len(colors) > PALETTE_MAX:
+        return None
+    index = {c: i for i, c in enumerate(colors)}
+    head = 2 + 3 * len(colors)
+    per_write = min(255, (room - head) * 2) & ~1
+    writes = []
+    for off in range(0, len(frame), per_write):
+        part = frame[off:off + per_write]
+        idx = [index[c] for c in part] + [0]
+        packed = bytes(idx[i] | (idx[i + 1] << 4) for i in range(0, len(part), 2))
+        pal = b"".join(bytes(c) for c in colors)
+        writes.append((PALETTE, off, bytes([len(colors), len(part)]) + pal + packed))
+    return writes
+
+
+def encode_delta(frame, prev, room):
+    """Spans of changed pixels; each write restarts at its header offset."""
+    writes, data, base, last = [], b"", 0, 0
+    i = 0
+    while i < len(frame):
+        if frame[i] == prev[i]:
+            i += 1
+            continue
+        if data and (len(data) + 5 > room or i - last > 255):
+            writes.append((DELTA, base, data))
+            data = b""
+        if not data:
+            base = last = i
+        room_px = (room - len(data) - 2) // 3
+        j = i
+        while j < len(frame) and frame[j] != prev[j] and j - i < min(255, room_px):
+            j += 1
+        data += bytes([i - last, j - i]) + b"".join(bytes(p) for p in frame[i:j])
+        last = i = j
+    if data or not writes:
+        writes.append((DELTA, base, data))
+    return writes
+
+
+def decode(canvas, blob):
+    """Mirror of led_stream_write(), raises on malformed input."""
+    fmt, _, pos = HDR.unpack_from(blob)
+    d = blob[HDR.size:]
+    if fmt == RAW:
+        for i in range(0, len(d), 3):
+            canvas[pos] = tuple(d[i:i + 3])
+            pos += 1
+    elif fmt == RLE:
+        for i in range(0, len(d), 4):
+            for _ in range(d[i]):
+                canvas[pos] = tuple(d[i + 1:i + 4])
+                pos += 1
+    elif fmt == PALETTE:
+        n, count = d[0], d[1]
+        pal = [tuple(d[2 + 3 * k:5 + 3 * k]) for k in range(n)]
+        idx = d[2 + 3 * n:]
+        for i in range(count):
+            c = idx[i >> 1] >> 4 if i & 1 else idx[i >> 1] & 0xF
+            canvas[pos + i] = pal[c]
+    elif fmt == DELTA:
+        i = 0
+        while i < len(d):
+            pos += d[i]
+            count = d[i + 1]
+            i += 2
+            for _ in range(count):
+                canvas[pos] = tuple(d[i:i + 3])
+                pos += 1
+                i += 3
+
+
+def frames(n):
+    """Test content: solid, 4-color bands, rainbow and a chase step."""
+    solid = [(255, 160, 64)] * n
+    bands = [[(255, 0, 0), (0, 255, 0), (0, 0, 255), (255, 255, 255)][i * 4 // n]
+             for i in range(n)]
+    rainbow = [tuple(int(v * 255) for v in colorsys.hsv_to_rgb(i / n, 1, 1))
+               for i in range(n)]
+    chase = list(rainbow)
+    chase[n // 2] = (255, 255, 255)
+    return [("solid", solid, solid), ("bands", bands, solid),
+            ("rainbow", rainbow, bands), ("chase step", chase, rainbow)]
+
+
+ENCODERS = [("raw", encode_raw), ("rle", encode_rle),
+            ("palette", encode_palette), ("delta", encode_delta)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--pixels", type=int, nargs="+", default=[16, 64, 300])
+    parser.add_argument("--mtu", type=int, default=247, help="negotiated ATT MTU")
+    parser.add_argument("--interval-ms", type=float, default=15.0,
+                        help="connection interval")
+    parser.add_argument("--writes-per-event", type=int, default=4,
+                        help="write-without-response packets per connection event")
+    args = parser.parse_args()
+
+    room = args.mtu - 3 - HDR.size
+    rate = args.writes_per_event * 1000.0 / args.interval_ms
+
+    print(f"MTU {args.mtu}, {rate:.0f} writes/s")
+    print(f"{'pixels':>6} {'content':<11} {'format':<8} {'bytes':>6} {'writes':>6} {'fps':>7}")
+    for n in args.pixels:
+        for name, frame, prev in frames(n):
+            for fmt_name, enc in ENCODERS:
+                writes = enc(frame, prev, room)
+                if writes is None:
+                    continue
+                canvas = list(prev)
+                for k, (fmt, off, data) in enumerate(writes):
+                    assert HDR.size + len(data) <= args.mtu - 3, f"{fmt_name} exceeds MTU"
+                    decode(canvas, write(fmt, off, data, k == len(writes) - 1))
+                assert canvas == frame, f"{fmt_name} round trip failed"
+                size = sum(HDR.size + len(d) for _, _, d in writes)
+                print(f"{n:>6} {name:<11} {fmt_name:<8} {size:>6} {len(writes):>6} "
+                      f"{rate / len(writes):>7.1f}")
+
+
+if __name__ == "__main__":
+    main()
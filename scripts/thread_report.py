@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""Stack high-water marks and CPU share per thread, under load on native_sim.
+
+Builds the sample for native_sim with threads.conf, which adds the thread
+report (CONFIG_SAMPLE_THREAD_STATS), with the emulated taps sped up to one
+every 5 ms. Every tap batch goes through the whole pipeline: sensor thread,
+FSM, render and transfer queues. The image runs for --duration seconds
+against the HCI device given with --bt-dev (native_sim has no controller
+of its own) and the report lines are folded into one table:
+
+  * stack: most bytes ever used, stack size and percentage
+  * cpu: mean share over the reports, the first one (boot) left out
+
+    scripts/thread_report.py --bt-dev hci0 --duration 30 -o threads.json
+
+Exits with 1 if a thread used more than --stack-limit percent of its
+stack, so it can gate a CI build.
+"""
+
+import argparse
+import json
+import pathlib
+import re
+import subprocess
+import sys
+
+APP_DIR = pathlib.Path(__file__).resolve().parent.parent
+BOARD = "native_sim"
+
+RE_ROW = re.compile(r"thread (.+?)\s+prio\s+(-?\d+) stack\s+(\d+)/\s*(\d+) cpu\s+([\d.]+)%")
+
+
+def build(build_dir, extra):
+    cmd = ["west", "build", "-p", "auto", "-b", BOARD, "-d", str(build_dir), str(APP_DIR), "--",
+           "-DEXTRA_CONF_FILE=threads.conf", "-DCONFIG_SAMPLE_TAP_EMUL_PERIOD_MS=5"]
+    subprocess.run(cmd + extra, check=True, stdout=subprocess.DEVNULL)
+    return build_dir / "zephyr" / "zephyr.exe"
+
+
+def run(exe, duration, bt_dev):
+    out = subprocess.run([str(exe), f"--bt-dev={bt_dev}", f"-stop_at={duration}"],
+                         capture_output=True, text=True, check=False)
+    return out.stdout
+
+
+def analyse(log):
+    reports = []
+    for line in log.splitlines():
+        if m := RE_ROW.search(line):
+            name, prio, used, size, cpu = m.groups()
+            # a new report starts whenever a thread shows up again
+            if not reports or name in reports[-1]:
+                reports.append({})
+            reports[-1][name] = (int(prio), int(used), int(size), float(cpu))
+
+    threads = {}
+    for i, report in enumerate(reports):
+        for name, (prio, used, size, cpu) in report.items():
+            t = threads.setdefault(name, {"prio": prio, "stack_used": 0,
+                                          "stack_size": size, "cpu": []})
+            t["stack_used"] = max(t["stack_used"], used)
+            if i > 0 or len(reports) == 1:
+                t["cpu"].append(cpu)
+
+    for t in threads.values():
+        t["stack_pct"] = round(t["stack_used"] * 100 / t["stack_size"], 1) if t["stack_size"] else None
+        t["cpu_pct"] = round(sum(t["cpu"]) / len(t["cpu"]), 1) if t["cpu"] else 0.0
+        del t["cpu"]
+    return {"reports": len(reports), "threads": threads}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--bt-dev", required=True,
+                        help="HCI device for the userchan driver, e.g. hci0 or 127.0.0.1:9000")
+    parser.add_argument("--duration", type=int, default=30, help="seconds to run")
+    parser.add_argument("--stack-limit", type=float, default=80.0,
+                        help="max percent of a stack any thread may use")
+    parser.add_argument("--build-dir", type=pathlib.Path, default=pathlib.Path("build-threads"))
+    parser.add_argument("-o", "--output", type=pathlib.Path, help="also write JSON here")
+    parser.add_argument("extra", nargs="*", help="extra CMake arguments, e.g. -DCONFIG_...")
+    args = parser.parse_args()
+
+    exe = build(args.build_dir, args.extra)
+    result = analyse(run(exe, args.duration, args.bt_dev))
+    if not result["reports"]:
+        sys.exit("no thread report in the output, is CONFIG_SAMPLE_THREAD_STATS on?")
+
+    print(f"{'thread':14} {'prio':>4} {'stack used':>16} {'cpu':>7}")
+    over = []
+    for name, t in sorted(result["threads"].items(), key=lambda kv: kv[1]["prio"]):
+        print(f"{name:14} {t['prio']:4} {t['stack_used']:6}/{t['stack_size']:<6}"
+              f"{t['stack_pct']:3.0f}% {t['cpu_pct']:6.1f}%")
+        if t["stack_pct"] is not None and t["stack_pct"] > args.stack_limit:
+            over.append(name)
+
+    if args.output:
+        args.output.write_text(json.dumps(result, indent=2) + "\n")
+    if over:
+        sys.exit(f"stack use above {args.stack_limit}%: {', '.join(over)}")
+
+
+if __name__ == "__main__":
+    main()
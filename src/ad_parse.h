@@ -0,0 +1,76 @@
+#ifndef AD_PARSE_H
+#define AD_PARSE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/net_buf.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Check whether an advertising payload lists a 128-bit service UUID.
+ *
+ * Walks the AD structures in place, so it is cheap enough to run on every
+ * scan report. @p uuid is in the little endian order of BT_UUID_128_ENCODE.
+ */
+static inline bool ad_has_uuid128(const struct net_buf_simple *ad, const uint8_t uuid[16])
+{
+	const uint8_t *p = ad->data;
+	const uint8_t *end = p + ad->len;
+
+	while (p < end && p[0] != 0) {
+		uint8_t len = p[0];
+		uint8_t type = p[1];
+
+		if (p + 1 + len > end) {
+			break; // malformed
+		}
+
+		if (type == BT_DATA_UUID128_ALL || type == BT_DATA_UUID128_SOME) {
+			for (uint8_t i = 2; i + 16 <= len + 1; i += 16) {
+				if (memcmp(&p[i], uuid, 16) == 0) {
+					return true;
+				}
+			}
+		}
+		p += 1 + len;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Find the first AD structure of @p type.
+ *
+ * @return Pointer to its data inside @p ad and its length in @p len, or
+ *         NULL if there is none.
+ */
+static inline const uint8_t *ad_find(const struct net_buf_simple *ad, uint8_t type,
+				     uint8_t *len)
+{
+	const uint8_t *p = ad->data;
+	const uint8_t *end = p + ad->len;
+
+	while (p < end && p[0] != 0) {
+		if (p + 1 + p[0] > end) {
+			break;
+		}
+		if (p[1] == type) {
+			*len = p[0] - 1;
+			return &p[2];
+		}
+		p += 1 + p[0];
+	}
+
+	return NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AD_PARSE_H
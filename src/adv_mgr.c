@@ -0,0 +1,364 @@
+/*
+ * Advertising manager: power/latency profiles for the phone connection.
+ *
+ * Every start walks the profiles: high duty directed advertising to the
+ * last bonded phone (if it is not already connected), fast undirected
+ * advertising for CONFIG_SAMPLE_ADV_FAST_TIMEOUT_MS, then slow advertising
+ * until someone connects. Directed advertising lets a bonded phone
+ * reconnect within a few advertising events instead of waiting for its
+ * scanner to catch an undirected one.
+ *
+ * Advertising restarts on its own whenever a phone disconnects, or
+ * connects while slots are left. All advertising calls run on the system
+ * work queue, so profile changes never race with restarts.
+ *
+ * With CONFIG_SAMPLE_ADV_STATS the time spent in each profile, the time
+ * from a (re)start to the phone's connection and an estimate of the
+ * average radio current are logged periodically. The current estimate is
+ * CONFIG_SAMPLE_ADV_EVENT_CHARGE_NC per advertising event on top of
+ * CONFIG_SAMPLE_ADV_SLEEP_UA, not a measurement.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(adv_mgr, LOG_LEVEL_INF);
+
+#include "adv_mgr.h"
+#include "ble_uuids.h"
+#include "central.h"
+
+#define ADV_OFF     ADV_PROFILES
+#define ADV_DELAY_US 5000  // mean random advDelay added to every interval
+
+struct profile {
+	const char *name;
+	uint16_t interval_min;  // 0.625 ms units, 0 for high duty directed
+	uint16_t interval_max;
+	uint32_t event_us;      // mean time between advertising events
+};
+
+static const struct profile profiles[ADV_PROFILES] = {
+	[ADV_DIRECTED] = { "directed", 0, 0, 3750 },
+	[ADV_FAST] = { "fast", BT_GAP_ADV_FAST_INT_MIN_2, BT_GAP_ADV_FAST_INT_MAX_2,
+		       BT_GAP_ADV_FAST_INT_MIN_2 * 625 + ADV_DELAY_US },
+	[ADV_SLOW] = { "slow", BT_GAP_ADV_SLOW_INT_MIN, BT_GAP_ADV_SLOW_INT_MAX,
+		       BT_GAP_ADV_SLOW_INT_MIN * 625 + ADV_DELAY_US },
+};
+
+/* Siblings match on the service UUID, the name moves to the scan response */
+static const struct bt_data adv_data[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+	BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_CONTROL_SERVICE_VAL),
+};
+
+static const struct bt_data scan_rsp[] = {
+	BT_DATA(BT_DATA_NAME_COMPLETE, CONFIG_BT_DEVICE_NAME,
+		sizeof(CONFIG_BT_DEVICE_NAME) - 1),
+};
+
+static atomic_t restart;
+static enum adv_profile profile = ADV_OFF;  // owned by the system work queue
+static int64_t profile_since;
+static int64_t seq_start;                  // uptime of the last (re)start
+
+#if defined(CONFIG_SAMPLE_ADV_DIRECTED)
+static bt_addr_le_t bond_peer;
+static bool have_bond;
+#endif
+
+#if defined(CONFIG_SAMPLE_ADV_STATS)
+struct profile_stats {
+	int64_t time_ms;
+	uint32_t connects;
+	uint32_t connect_ms_sum;
+	uint32_t connect_ms_max;
+};
+
+static struct profile_stats stats[ADV_PROFILES];
+static int64_t stats_since;
+
+static uint32_t profile_ua(enum adv_profile p)
+{
+	return CONFIG_SAMPLE_ADV_SLEEP_UA +
+	       CONFIG_SAMPLE_ADV_EVENT_CHARGE_NC * 1000U / profiles[p].event_us;
+}
+
+static void stats_leave(int64_t now)
+{
+	if (profile != ADV_OFF) {
+		stats[profile].time_ms += now - profile_since;
+	}
+}
+
+static void stats_connect(int64_t now)
+{
+	uint32_t ms = now - seq_start;
+
+	stats[profile].connects++;
+	stats[profile].connect_ms_sum += ms;
+	stats[profile].connect_ms_max = MAX(stats[profile].connect_ms_max, ms);
+	LOG_INF("Phone connected on %s advertising, %u ms after start",
+		profiles[profile].name, ms);
+}
+
+static void adv_stats_report(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(stats_work, adv_stats_report);
+
+/* Runs on the system work queue like the rest of the state */
+static void adv_stats_report(struct k_work *work)
+{
+	int64_t now = k_uptime_get();
+	uint64_t charge = 0;  // uA x ms
+	int64_t period = MAX(now - stats_since, 1);
+	int64_t adv_ms = 0;
+
+	stats_leave(now);
+	profile_since = now;
+
+	for (int p = 0; p < ADV_PROFILES; p++) {
+		const struct profile_stats *s = &stats[p];
+
+		LOG_INF("adv %s: %lld ms, ~%u uA, %u connects, reconnect avg %u ms max %u ms",
+			profiles[p].name, s->time_ms, profile_ua(p), s->connects,
+			s->connects ? s->connect_ms_sum / s->connects : 0, s->connect_ms_max);
+		charge += (uint64_t)s->time_ms * profile_ua(p);
+		adv_ms += s->time_ms;
+	}
+	charge += (uint64_t)(period - adv_ms) * CONFIG_SAMPLE_ADV_SLEEP_UA;
+	LOG_INF("adv: ~%u uA average over %lld s", (uint32_t)(charge / period), period / 1000);
+
+	memset(stats, 0, sizeof(stats));
+	stats_since = now;
+	k_work_schedule(&stats_work, K_SECONDS(CONFIG_SAMPLE_ADV_STATS_INTERVAL));
+}
+#else
+static inline void stats_leave(int64_t now) {}
+static inline void stats_connect(int64_t now) {}
+#endif /* CONFIG_SAMPLE_ADV_STATS */
+
+#if defined(CONFIG_SAMPLE_ADV_DIRECTED)
+static void pick_bond(const struct bt_bond_info *info, void *user_data)
+{
+	if (!have_bond) {
+		bt_addr_le_copy(&bond_peer, &info->addr);
+		have_bond = true;
+	}
+}
+
+/* The bonded phone, unless it is connected already */
+static bool directed_target(void)
+{
+	struct bt_conn *conn;
+
+	if (!have_bond) {
+		bt_foreach_bond(BT_ID_DEFAULT, pick_bond, NULL);
+		if (!have_bond) {
+			return false;
+		}
+	}
+
+	conn = bt_conn_lookup_addr_le(BT_ID_DEFAULT, &bond_peer);
+	if (conn) {
+		bt_conn_unref(conn);
+		return false;
+	}
+	return true;
+}
+#else
+static inline bool directed_target(void)
+{
+	return false;
+}
+#endif /* CONFIG_SAMPLE_ADV_DIRECTED */
+
+static int profile_start(enum adv_profile p)
+{
+	struct bt_le_adv_param param =
+		BT_LE_ADV_PARAM_INIT(BT_LE_ADV_OPT_CONN, profiles[p].interval_min,
+				     profiles[p].interval_max, NULL);
+
+#if defined(CONFIG_SAMPLE_ADV_DIRECTED)
+	if (p == ADV_DIRECTED) {
+		// high duty: the controller gives up after 1.28 s on its own
+		param = *BT_LE_ADV_CONN_DIR(&bond_peer);
+		return bt_le_adv_start(&param, NULL, 0, NULL, 0);
+	}
+#endif
+	return bt_le_adv_start(&param, adv_data, ARRAY_SIZE(adv_data),
+			       scan_rsp, ARRAY_SIZE(scan_rsp));
+}
+
+static void adv_step(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(adv_work, adv_step);
+
+/* Start the next profile: the first after a restart, else the one after */
+static void adv_step(struct k_work *work)
+{
+	int64_t now = k_uptime_get();
+	enum adv_profile next;
+	int err;
+
+	if (atomic_clear(&restart)) {
+		seq_start = now;
+		next = directed_target() ? ADV_DIRECTED : ADV_FAST;
+	} else if (profile < ADV_SLOW) {
+		next = profile + 1;
+	} else {
+		return;
+	}
+
+	bt_le_adv_stop();
+	stats_leave(now);
+	profile = ADV_OFF;
+
+	err = profile_start(next);
+	if (err) {
+		LOG_ERR("%s advertising failed (err %d)", profiles[next].name, err);
+		return;
+	}
+
+	profile = next;
+	profile_since = now;
+	LOG_INF("Advertising: %s", profiles[next].name);
+
+	if (next == ADV_FAST) {
+		k_work_schedule(&adv_work, K_MSEC(CONFIG_SAMPLE_ADV_FAST_TIMEOUT_MS));
+	}
+}
+
+void adv_mgr_start(void)
+{
+	atomic_set(&restart, 1);
+	k_work_reschedule(&adv_work, K_NO_WAIT);
+}
+
+uint32_t adv_mgr_event_us(void)
+{
+	enum adv_profile p = profile;
+
+	return p == ADV_OFF ? 0 : profiles[p].event_us;
+}
+
+/* Phones and sibling links take connection slots alike */
+static void count_link(struct bt_conn *conn, void *data)
+{
+	struct bt_conn_info info;
+
+	if (bt_conn_get_info(conn, &info) == 0 && info.state == BT_CONN_STATE_CONNECTED) {
+		(*(unsigned int *)data)++;
+	}
+}
+
+/* Connection callbacks run on the BT RX thread, hand over to the work queue */
+static atomic_t phone_connected;
+static atomic_t adv_changed;    // a link came in through us or a phone left
+static bool slots_full;         // work queue only
+
+static void conn_work_fn(struct k_work *work)
+{
+	int64_t now = k_uptime_get();
+	unsigned int links = 0;
+
+	// advertising stops when a phone connects
+	if (atomic_clear(&phone_connected) && profile != ADV_OFF) {
+		stats_connect(now);
+		stats_leave(now);
+		profile = ADV_OFF;
+	}
+
+	// with every slot taken a connectable advertiser cannot start
+	bt_conn_foreach(BT_CONN_TYPE_LE, count_link, &links);
+	if (links >= CONFIG_BT_MAX_CONN) {
+		slots_full = true;
+		k_work_cancel_delayable(&adv_work);
+		return;
+	}
+
+	// a sibling coming or going leaves a running sequence alone
+	if (atomic_clear(&adv_changed) || slots_full) {
+		adv_mgr_start();
+	}
+	slots_full = false;
+}
+
+static K_WORK_DEFINE(conn_work, conn_work_fn);
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	struct bt_conn_info info;
+
+	if (err == BT_HCI_ERR_ADV_TIMEOUT) {
+		// directed advertising ran out, carry on with the next profile
+		k_work_reschedule(&adv_work, K_NO_WAIT);
+		return;
+	}
+
+	if (err) {
+		return;
+	}
+
+	// an inbound link, sibling or phone, ended our advertising
+	if (bt_conn_get_info(conn, &info) == 0 && info.role == BT_CONN_ROLE_PERIPHERAL) {
+		atomic_set(&adv_changed, 1);
+	}
+	// a sibling link may take the last slot too
+	if (!central_is_phone(conn)) {
+		k_work_submit(&conn_work);
+		return;
+	}
+
+	atomic_set(&phone_connected, 1);
+	k_work_submit(&conn_work);
+
+#if defined(CONFIG_SAMPLE_ADV_DIRECTED)
+	// Just Works pairing; the bond is what directed advertising needs
+	bt_conn_set_security(conn, BT_SECURITY_L2);
+#endif
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	if (central_is_phone(conn)) {
+		atomic_set(&adv_changed, 1);
+	}
+	k_work_submit(&conn_work);
+}
+
+#if defined(CONFIG_SAMPLE_ADV_DIRECTED)
+static void security_changed(struct bt_conn *conn, bt_security_t level,
+			     enum bt_security_err err)
+{
+	if (err || level < BT_SECURITY_L2) {
+		return;
+	}
+
+	// the phone that paired last is the one directed advertising targets
+	bt_addr_le_copy(&bond_peer, bt_conn_get_dst(conn));
+	have_bond = true;
+}
+#endif
+
+BT_CONN_CB_DEFINE(adv_conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+#if defined(CONFIG_SAMPLE_ADV_DIRECTED)
+	.security_changed = security_changed,
+#endif
+};
+
+static int adv_mgr_init(void)
+{
+#if defined(CONFIG_SAMPLE_ADV_STATS)
+	stats_since = k_uptime_get();
+	k_work_schedule(&stats_work, K_SECONDS(CONFIG_SAMPLE_ADV_STATS_INTERVAL));
+#endif
+	return 0;
+}
+
+SYS_INIT(adv_mgr_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
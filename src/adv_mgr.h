@@ -0,0 +1,35 @@
+#ifndef ADV_MGR_H
+#define ADV_MGR_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Advertising profiles, tried in this order after every (re)start */
+enum adv_profile {
+	ADV_DIRECTED,  // high duty cycle, to the last bonded phone, 1.28 s
+	ADV_FAST,      // 100-150 ms, for CONFIG_SAMPLE_ADV_FAST_TIMEOUT_MS
+	ADV_SLOW,      // 1-1.2 s until a phone connects
+	ADV_PROFILES,
+};
+
+/**
+ * @brief (Re)start the profile sequence from the top. Safe from any
+ * thread; the work runs on the system work queue. Call once Bluetooth is
+ * ready, later restarts after connects and disconnects are automatic.
+ */
+void adv_mgr_start(void);
+
+/**
+ * @brief Mean time between advertising events of the running profile in
+ * us, 0 when not advertising. For current estimates.
+ */
+uint32_t adv_mgr_event_us(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADV_MGR_H
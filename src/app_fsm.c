@@ -0,0 +1,694 @@
+/*
+ * The application state machine and the command path.
+ *
+ * Bluetooth, GPIO and sensor callbacks post FSM_EVT_* bits; only the main
+ * thread, in app_fsm_run(), takes them and runs the state machine. Control
+ * writes are decoded by app_cmd_write() and queued per peer, then applied
+ * by the FSM in arrival order. Nothing here touches the Bluetooth stack,
+ * so the tests/hotpath_bench image runs it without a controller.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/smf.h>
+#include "led_strip_src/led_strip.h"
+#include "motor_src/motor.h"
+#include "button_src/button.h"
+#include "app_fsm.h"
+#include "cmd_queue.h"
+#include "telemetry.h"
+#include "conn_policy.h"
+#include "group_sync.h"
+#include "app_settings.h"
+#include "diag.h"
+#include "adv_mgr.h"
+#include "fsm_trace.h"
+#include "power.h"
+
+LOG_MODULE_REGISTER(app_fsm, LOG_LEVEL_INF);
+
+static int sensor_led_mode = 0; // mode state flag
+static uint32_t last_tap_seq = 0;
+
+BUILD_ASSERT(EVT_COUNT <= FSM_TRACE_EVENTS);
+BUILD_ASSERT(STATE_COUNT <= FSM_TRACE_STATES);
+
+#define CMD_BATCH 8
+#define FSM_POLL_MS 10  // CONFIG_SAMPLE_FSM_POLL_BASELINE period
+
+static K_EVENT_DEFINE(fsm_events);
+
+/* The SMF context must come first, SMF_CTX() casts the object */
+static struct fsm {
+	struct smf_ctx ctx;
+	enum fsm_event event;  // being dispatched
+} fsm;
+
+static atomic_t conn_count;
+static app_fsm_led_cb_t status_led;
+
+#if defined(CONFIG_SAMPLE_FSM_STATS)
+/*
+ * Wakeup/latency counters for the FSM thread. A report is logged every
+ * CONFIG_SAMPLE_FSM_STATS_INTERVAL seconds from the system work queue.
+ */
+static uint32_t stats_wakeups;
+static uint32_t stats_dispatched;
+static uint32_t stats_superseded; // LED commands overwritten by a later writer
+static uint64_t stats_lat_sum;  // cycles
+static uint32_t stats_lat_max;  // cycles
+
+static void fsm_stats_report(struct k_work *work)
+{
+	static struct cmd_queue_stats prev[CMD_QUEUE_PEERS];
+	struct cmd_queue_stats q;
+	uint32_t n = stats_dispatched;
+	uint32_t avg_us = n ? k_cyc_to_us_floor32(stats_lat_sum / n) : 0;
+
+	LOG_INF("FSM: %u wakeups/s, write-to-dispatch avg %u us max %u us (%u cmds)",
+		stats_wakeups / CONFIG_SAMPLE_FSM_STATS_INTERVAL, avg_us,
+		k_cyc_to_us_floor32(stats_lat_max), n);
+
+	for (int i = 0; i < CMD_QUEUE_PEERS; i++) {
+		cmd_queue_get_stats(i, &q);
+		if (q.enqueued == prev[i].enqueued && q.dropped == prev[i].dropped) {
+			continue; // quiet slot
+		}
+		LOG_INF("Command queue %d: %u cmds/s, %u dropped, high water %u/%u", i,
+			(q.enqueued - prev[i].enqueued) / CONFIG_SAMPLE_FSM_STATS_INTERVAL,
+			q.dropped - prev[i].dropped, q.high_water,
+			CONFIG_SAMPLE_CMD_QUEUE_SIZE);
+		prev[i] = q;
+	}
+	LOG_INF("Superseded LED commands: %u", stats_superseded);
+
+	stats_wakeups = 0;
+	stats_dispatched = 0;
+	stats_superseded = 0;
+	stats_lat_sum = 0;
+	stats_lat_max = 0;
+
+	k_work_schedule(k_work_delayable_from_work(work),
+			K_SECONDS(CONFIG_SAMPLE_FSM_STATS_INTERVAL));
+}
+
+static K_WORK_DELAYABLE_DEFINE(stats_work, fsm_stats_report);
+
+static inline void fsm_stats_wakeup(void)
+{
+	stats_wakeups++;
+}
+
+static inline void fsm_stats_dispatch(uint32_t stamp)
+{
+	uint32_t lat = k_cycle_get_32() - stamp;
+
+	stats_dispatched++;
+	stats_lat_sum += lat;
+	stats_lat_max = MAX(stats_lat_max, lat);
+}
+
+static inline void fsm_stats_superseded(void)
+{
+	stats_superseded++;
+}
+#else
+static inline void fsm_stats_wakeup(void) {}
+static inline void fsm_stats_dispatch(uint32_t stamp) {}
+static inline void fsm_stats_superseded(void) {}
+#endif /* CONFIG_SAMPLE_FSM_STATS */
+
+
+/* Parses a control write once and queues it for the FSM */
+ssize_t app_cmd_write(uint8_t peer, enum app_cmd_type type, const void *buf,
+		      uint16_t len, uint16_t offset)
+{
+	struct app_cmd cmd = {
+		.type = type,
+		.peer = peer,
+		.zone = 0,
+		.stamp = k_cycle_get_32(),
+	};
+
+	LOG_HEXDUMP_DBG(buf, len, "Received command:");
+
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	if (cmd.type == APP_CMD_LED) {
+		// an optional 7th byte picks the zone
+		if (len != sizeof(led_cmd_t) && len != sizeof(led_cmd_t) + 1) {
+			return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+		}
+		memcpy(&cmd.led, buf, sizeof(led_cmd_t));
+		if (len > sizeof(led_cmd_t)) {
+			cmd.zone = ((const uint8_t *)buf)[sizeof(led_cmd_t)];
+			if (cmd.zone >= APP_LED_ZONES) {
+				return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+			}
+		}
+	}
+
+	if (cmd_queue_put(&cmd)) {
+		diag_count(DIAG_C_CMD_DROPPED);
+		// queue full: let the phone retry, or drop silently
+		return IS_ENABLED(CONFIG_SAMPLE_CMD_QUEUE_OVERFLOW_REJECT) ?
+		       BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES) : len;
+	}
+
+	diag_count(DIAG_C_CMD_RX);
+	k_event_post(&fsm_events, FSM_EVT_CMD);
+	return len;
+}
+
+#if defined(CONFIG_SAMPLE_CMD_EMUL)
+/*
+ * A stand-in phone on connection slot 0, which no real phone uses on the
+ * simulated boards: a color wheel, one LED write per
+ * CONFIG_SAMPLE_CMD_EMUL_PERIOD_MS.
+ */
+static void cmd_emul_fn(struct k_timer *timer)
+{
+	static uint8_t hue;
+	led_cmd_t led = { .mode = LED_MODE_RGB, .r = hue, .g = 255 - hue,
+			  .brightness = 50, .duration = 0 };
+
+	hue += 16;
+	app_cmd_write(0, APP_CMD_LED, &led, sizeof(led), 0);
+}
+
+static K_TIMER_DEFINE(cmd_emul_timer, cmd_emul_fn, NULL);
+
+void app_cmd_emul_start(void)
+{
+	k_timer_start(&cmd_emul_timer, K_MSEC(CONFIG_SAMPLE_CMD_EMUL_PERIOD_MS),
+		      K_MSEC(CONFIG_SAMPLE_CMD_EMUL_PERIOD_MS));
+}
+#endif /* CONFIG_SAMPLE_CMD_EMUL */
+
+void app_fsm_post(uint32_t events)
+{
+	k_event_post(&fsm_events, events);
+}
+
+unsigned int app_fsm_phone(bool connected)
+{
+	atomic_val_t n;
+
+	if (connected) {
+		n = atomic_inc(&conn_count) + 1;
+		k_event_post(&fsm_events, FSM_EVT_CONNECTED);
+	} else {
+		n = atomic_dec(&conn_count) - 1;
+		k_event_post(&fsm_events, FSM_EVT_DISCONNECTED);
+	}
+	return n;
+}
+
+const char *motor_status(void)
+{
+	return motor_is_armed() ? "ON" : "OFF";
+}
+
+// button brightness handle, one strip refresh per burst of presses
+void button_handler(void)
+{
+	int steps = button_take_steps();
+
+	if (steps == 0) {
+		return;
+	}
+
+	// every zone keeps its own mode and color
+	uint8_t brightness = led_strip_step_brightness(steps * 10);
+
+	printk(">> Global Brightness %s: %d\n", steps > 0 ? "++" : "--", brightness);
+}
+
+/* A tap batch turned into a mode change, sensor thread -> FSM */
+struct tap_msg {
+	uint8_t mode;
+	uint32_t seq;    // last tap of the batch
+	uint32_t stamp;  // its edge, in cycles
+};
+
+K_MSGQ_DEFINE(tap_msgq, sizeof(struct tap_msg), CONFIG_SAMPLE_TAP_MSGQ_LEN, 4);
+
+/* Runs on the sensor thread; the FSM only sees one message per batch */
+void app_fsm_taps(const struct tap_event *taps, size_t n)
+{
+	static uint32_t seq;
+	static uint32_t stamp;
+	static uint8_t mode;
+	uint32_t interval = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		// gaps are counted by motor_tap_dropped() and go out in telemetry
+		if (taps[i].seq != seq + 1) {
+			LOG_DBG("Missed %u taps", taps[i].seq - seq - 1);
+		}
+		telemetry_tap(taps[i].seq, taps[i].timestamp);
+		diag_count(DIAG_C_TAPS);
+		interval = taps[i].timestamp - stamp;
+		seq = taps[i].seq;
+		stamp = taps[i].timestamp;
+	}
+	LOG_DBG("Taps %u..%u, last interval %u us", taps[0].seq, seq,
+		k_cyc_to_us_floor32(interval));
+
+	mode = (mode + n) % 3;
+	struct tap_msg msg = { .mode = mode, .seq = seq, .stamp = stamp };
+
+	// only the newest mode matters, make room if the FSM is behind
+	while (k_msgq_put(&tap_msgq, &msg, K_NO_WAIT) != 0) {
+		k_msgq_purge(&tap_msgq);
+	}
+	k_event_post(&fsm_events, FSM_EVT_TAP);
+}
+
+/* Apply the newest mode from the sensor thread; the strip is refreshed once */
+static void tap_handler(void)
+{
+	struct tap_msg msg;
+	bool got = false;
+
+	while (k_msgq_get(&tap_msgq, &msg, K_NO_WAIT) == 0) {
+		got = true;
+	}
+	if (!got) {
+		return;
+	}
+
+	sensor_led_mode = msg.mode;
+	last_tap_seq = msg.seq;
+	printk("Tap detected! New mode: %d\n", sensor_led_mode);
+	// every zone keeps its own color and brightness
+	led_strip_set_mode(sensor_led_mode);
+	diag_since(DIAG_H_TAP_MODE, msg.stamp);
+}
+
+static const struct smf_state states[STATE_COUNT];
+static const char *const event_names[EVT_COUNT];
+
+ble_state_t app_fsm_state(void)
+{
+	return fsm.ctx.current - states;
+}
+
+static void cmd_handler(const struct app_cmd *cmd)
+{
+	switch (cmd->type) {
+	case APP_CMD_LED:
+		printk(">> LED command (brightness: %d) <<\n", cmd->led.brightness);
+		// an LED command ends motor config
+		if (app_fsm_state() == STATE_MOTOR_CONFIG) {
+			smf_set_state(SMF_CTX(&fsm), &states[STATE_LED_CTRL]);
+		}
+#if defined(CONFIG_SAMPLE_GROUP_SYNC)
+		// the whole group, this unit included, applies it at the same time;
+		// zones are local to this strip
+		if (cmd->zone == 0 && group_sync_publish(&cmd->led) == 0) {
+			break;
+		}
+#endif
+		led_strip_control_zone(cmd->zone, &cmd->led);
+		break;
+	case APP_CMD_MOTOR:
+		printk(">> Motor control triggered <<\n");
+		LOG_INF("Motor state: %s, taps: %u, dropped: %u", motor_status(),
+			last_tap_seq, motor_tap_dropped());
+		break;
+	case APP_CMD_MOTOR_CFG:
+		// only with a phone connected, the buttons leave it again otherwise
+		if (app_fsm_state() == STATE_LED_CTRL) {
+			smf_set_state(SMF_CTX(&fsm), &states[STATE_MOTOR_CONFIG]);
+		}
+		break;
+	}
+
+	// write-to-apply time, reported with the link parameters
+	conn_policy_cmd_latency(k_cyc_to_us_floor32(k_cycle_get_32() - cmd->stamp));
+	diag_since(DIAG_H_WRITE_APPLY, cmd->stamp);
+}
+
+/* Apply the newest pending LED write of each zone, then forget them */
+static void led_flush(struct app_cmd led[APP_LED_ZONES], bool pending[APP_LED_ZONES])
+{
+	bool whole = pending[0];
+
+	for (size_t z = 0; z < APP_LED_ZONES; z++) {
+		if (!pending[z]) {
+			continue;
+		}
+		pending[z] = false;
+		if (z && whole && (int32_t)(led[z].stamp - led[0].stamp) < 0) {
+			fsm_stats_superseded();
+			continue;
+		}
+		cmd_handler(&led[z]);
+	}
+}
+
+/*
+ * Peers are served round-robin, CMD_BATCH at a time. LED writes are
+ * last-writer-wins per zone: of a run of LED writes, only the newest one
+ * by arrival time is applied. Zone 0 covers every zone, so a zone write
+ * older than it is dropped too. Any other command first applies the LED
+ * writes taken before it, since they can change the state it acts on.
+ */
+static void cmd_dispatch(void)
+{
+	struct app_cmd cmds[CMD_BATCH];
+	struct app_cmd led[APP_LED_ZONES];
+	bool led_pending[APP_LED_ZONES] = { false };
+	size_t n;
+
+	while ((n = cmd_queue_get(cmds, ARRAY_SIZE(cmds))) > 0) {
+		for (size_t i = 0; i < n; i++) {
+			const struct app_cmd *cmd = &cmds[i];
+
+			fsm_stats_dispatch(cmd->stamp);
+			diag_since(DIAG_H_WRITE_DISPATCH, cmd->stamp);
+			if (cmd->type != APP_CMD_LED) {
+				led_flush(led, led_pending);
+				cmd_handler(cmd);
+				continue;
+			}
+
+			if (led_pending[cmd->zone]) {
+				fsm_stats_superseded();
+				if ((int32_t)(cmd->stamp - led[cmd->zone].stamp) < 0) {
+					continue; // an older write from a slower peer
+				}
+			}
+			led[cmd->zone] = *cmd;
+			led_pending[cmd->zone] = true;
+		}
+	}
+
+	led_flush(led, led_pending);
+}
+
+/*
+ * Event handlers, one table row per state. A state without a handler for
+ * an event passes it to its parent; ROOT handles or drops everything.
+ */
+typedef enum smf_state_result (*fsm_handler_t)(void);
+
+static enum smf_state_result root_cmd(void)
+{
+	cmd_dispatch();
+	return SMF_EVENT_HANDLED;
+}
+
+static enum smf_state_result root_tap(void)
+{
+	tap_handler();
+	return SMF_EVENT_HANDLED;
+}
+
+static enum smf_state_result root_group(void)
+{
+#if defined(CONFIG_SAMPLE_GROUP_SYNC)
+	led_cmd_t led;
+
+	if (group_sync_take(&led)) {
+		led_strip_control(&led);
+	}
+#endif
+	return SMF_EVENT_HANDLED;
+}
+
+static enum smf_state_result root_button(void)
+{
+	button_take_steps(); // buttons only act in config mode
+	return SMF_EVENT_HANDLED;
+}
+
+static enum smf_state_result idle_advertise(void)
+{
+	smf_set_state(SMF_CTX(&fsm), &states[STATE_PERIPHERAL]);
+	return SMF_EVENT_HANDLED;
+}
+
+static enum smf_state_result peripheral_connected(void)
+{
+	smf_set_state(SMF_CTX(&fsm), &states[STATE_LED_CTRL]);
+	return SMF_EVENT_HANDLED;
+}
+
+static enum smf_state_result peripheral_idle(void)
+{
+	if (led_strip_dark()) {
+		smf_set_state(SMF_CTX(&fsm), &states[STATE_DEEP_IDLE]);
+	}
+	return SMF_EVENT_HANDLED;
+}
+
+static enum smf_state_result deep_idle_wake(void)
+{
+	// the exit action takes the devices back, then the event runs as usual
+	smf_set_state(SMF_CTX(&fsm), &states[STATE_PERIPHERAL]);
+	k_event_post(&fsm_events, BIT(fsm.event));
+	return SMF_EVENT_HANDLED;
+}
+
+static enum smf_state_result deep_idle_stay(void)
+{
+	return SMF_EVENT_HANDLED;
+}
+
+static enum smf_state_result led_ctrl_disconnected(void)
+{
+	if (atomic_get(&conn_count) == 0) {
+		smf_set_state(SMF_CTX(&fsm), &states[STATE_PERIPHERAL]);
+	}
+	return SMF_EVENT_HANDLED;
+}
+
+static enum smf_state_result motor_config_button(void)
+{
+	button_handler();
+	return SMF_EVENT_HANDLED;
+}
+
+static const fsm_handler_t handlers[STATE_COUNT][EVT_COUNT] = {
+	[STATE_ROOT] = {
+		[EVT_CMD] = root_cmd,
+		[EVT_TAP] = root_tap,
+		[EVT_GROUP] = root_group,
+		[EVT_BUTTON] = root_button,
+	},
+	[STATE_IDLE] = {
+		[EVT_ADVERTISE] = idle_advertise,
+	},
+	[STATE_PERIPHERAL] = {
+		[EVT_CONNECTED] = peripheral_connected,
+		[EVT_IDLE] = peripheral_idle,
+	},
+	[STATE_LED_CTRL] = {
+		[EVT_DISCONNECTED] = led_ctrl_disconnected,
+	},
+	[STATE_MOTOR_CONFIG] = {
+		[EVT_BUTTON] = motor_config_button,
+	},
+	[STATE_DEEP_IDLE] = {
+		[EVT_CONNECTED] = deep_idle_wake,
+		[EVT_CMD] = deep_idle_wake,
+		[EVT_TAP] = deep_idle_wake,
+		[EVT_GROUP] = deep_idle_wake,
+		[EVT_BUTTON] = deep_idle_wake,
+		[EVT_IDLE] = deep_idle_stay,
+	},
+};
+
+static inline enum smf_state_result fsm_handle(ble_state_t state)
+{
+	fsm_handler_t h = handlers[state][fsm.event];
+
+	if (h) {
+		return h();
+	}
+	return state == STATE_ROOT ? SMF_EVENT_HANDLED : SMF_EVENT_PROPAGATE;
+}
+
+#define STATE_RUN(_name, _state)                                  \
+	static enum smf_state_result _name##_run(void *obj)       \
+	{                                                         \
+		return fsm_handle(_state);                        \
+	}
+
+STATE_RUN(root, STATE_ROOT)
+STATE_RUN(idle, STATE_IDLE)
+STATE_RUN(peripheral, STATE_PERIPHERAL)
+STATE_RUN(led_ctrl, STATE_LED_CTRL)
+STATE_RUN(motor_config, STATE_MOTOR_CONFIG)
+STATE_RUN(deep_idle, STATE_DEEP_IDLE)
+
+static void peripheral_entry(void *obj)
+{
+	printk("Acting as Peripheral...\n");
+	adv_mgr_start();
+	power_arm();
+}
+
+static void deep_idle_entry(void *obj)
+{
+	power_suspend();
+}
+
+static void deep_idle_exit(void *obj)
+{
+	power_resume(event_names[fsm.event]);
+}
+
+static void led_ctrl_entry(void *obj)
+{
+	if (status_led) {
+		status_led(true);
+	}
+}
+
+static void led_ctrl_exit(void *obj)
+{
+	if (status_led) {
+		status_led(false);
+	}
+}
+
+static void motor_config_entry(void *obj)
+{
+	led_cmd_t whole;
+
+	printk(">> STATE_MOTOR_CONFIG : ON <<\n");
+	printk("Global brightness control: 0-100 (10 units per press)\n");
+	if (led_strip_zone_get(0, &whole)) {
+		printk("Current brightness: %d\n", whole.brightness);
+	}
+}
+
+static void motor_config_exit(void *obj)
+{
+	printk(">> STATE_MOTOR_CONFIG : OFF <<\n");
+}
+
+static const struct smf_state states[STATE_COUNT] = {
+	[STATE_ROOT] = SMF_CREATE_STATE(NULL, root_run, NULL, NULL, NULL),
+	[STATE_IDLE] = SMF_CREATE_STATE(NULL, idle_run, NULL, &states[STATE_ROOT], NULL),
+	[STATE_PERIPHERAL] = SMF_CREATE_STATE(peripheral_entry, peripheral_run, NULL,
+					      &states[STATE_ROOT], NULL),
+	[STATE_LED_CTRL] = SMF_CREATE_STATE(led_ctrl_entry, led_ctrl_run, led_ctrl_exit,
+					    &states[STATE_ROOT], NULL),
+	[STATE_MOTOR_CONFIG] = SMF_CREATE_STATE(motor_config_entry, motor_config_run,
+						motor_config_exit, &states[STATE_LED_CTRL], NULL),
+	[STATE_DEEP_IDLE] = SMF_CREATE_STATE(deep_idle_entry, deep_idle_run, deep_idle_exit,
+					     &states[STATE_PERIPHERAL], NULL),
+};
+
+static const char *const state_names[STATE_COUNT] = {
+	[STATE_IDLE] = "idle",
+	[STATE_PERIPHERAL] = "peripheral",
+	[STATE_LED_CTRL] = "led_ctrl",
+	[STATE_MOTOR_CONFIG] = "motor_config",
+	[STATE_DEEP_IDLE] = "deep_idle",
+	[STATE_ROOT] = "root",
+};
+
+static const char *const event_names[EVT_COUNT] = {
+	[EVT_ADVERTISE] = "advertise",
+	[EVT_CONNECTED] = "connected",
+	[EVT_CMD] = "cmd",
+	[EVT_TAP] = "tap",
+	[EVT_GROUP] = "group",
+	[EVT_BUTTON] = "button",
+	[EVT_DISCONNECTED] = "disconnected",
+	[EVT_IDLE] = "idle",
+};
+
+/* Dispatch one batch of events; only this thread runs the state machine */
+static void fsm_dispatch(uint32_t events)
+{
+	while (events) {
+		uint8_t from = app_fsm_state();
+		uint32_t start = k_cycle_get_32();
+
+		fsm.event = find_lsb_set(events) - 1;
+		events &= events - 1;
+		smf_run_state(SMF_CTX(&fsm));
+		fsm_trace_record(fsm.event, from, app_fsm_state(), k_cycle_get_32() - start);
+	}
+}
+
+/* Publish what the last batch changed; telemetry skips unchanged values */
+static void fsm_publish(void)
+{
+	struct cmd_queue_stats q;
+
+	cmd_queue_get_stats(-1, &q);
+
+	struct telemetry_counters counters = {
+		.cmds = q.enqueued,
+		.cmds_dropped = q.dropped,
+		.taps = last_tap_seq,
+		.taps_dropped = motor_tap_dropped(),
+	};
+
+	telemetry_state(app_fsm_state());
+	telemetry_led_cmd(get_last_led_cmd());
+	telemetry_counters(&counters);
+	for (uint8_t z = 0; z < LED_ZONES; z++) {
+		led_cmd_t zone;
+
+		app_settings_save_led(z, led_strip_zone_get(z, &zone) ? &zone : NULL);
+	}
+}
+
+void app_fsm_init(app_fsm_led_cb_t led)
+{
+	status_led = led;
+	fsm_trace_init(state_names, ARRAY_SIZE(state_names), event_names,
+		       ARRAY_SIZE(event_names));
+	smf_set_initial(SMF_CTX(&fsm), &states[STATE_IDLE]);
+}
+
+uint32_t app_fsm_poll(void)
+{
+	uint32_t events = k_event_test(&fsm_events, FSM_EVT_ALL);
+
+	if (events == 0) {
+		return 0;
+	}
+	k_event_clear(&fsm_events, events);
+
+	fsm_dispatch(events);
+	fsm_publish();
+	// activity starts the countdown over; the strip arms it when it settles
+	if (app_fsm_state() == STATE_PERIPHERAL && (events & ~FSM_EVT_IDLE)) {
+		power_arm();
+	}
+	return events;
+}
+
+void app_fsm_run(void)
+{
+#if defined(CONFIG_SAMPLE_FSM_STATS)
+	k_work_schedule(&stats_work, K_SECONDS(CONFIG_SAMPLE_FSM_STATS_INTERVAL));
+#endif
+
+	// sleep until a GATT write, tap or button event arrives
+	while (1) {
+#if defined(CONFIG_SAMPLE_FSM_POLL_BASELINE)
+		// the old loop, for comparison: look for work every 10 ms
+		k_sleep(K_MSEC(FSM_POLL_MS));
+#else
+		k_event_wait(&fsm_events, FSM_EVT_ALL, false, K_FOREVER);
+#endif
+		fsm_stats_wakeup();
+		app_fsm_poll();
+	}
+}
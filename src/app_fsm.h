@@ -0,0 +1,121 @@
+#ifndef APP_FSM_H
+#define APP_FSM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <zephyr/sys/util.h>
+#include "cmd_queue.h"
+#include "motor_src/motor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * FSM states, numbered as reported in telemetry. STATE_ROOT is the common
+ * parent and never current:
+ *
+ *   ROOT                 commands, taps, group sync, stray button steps
+ *   +- IDLE              Bluetooth not up yet
+ *   +- PERIPHERAL        advertising, no phone connected
+ *   |  +- DEEP_IDLE      strip dark, bus and console suspended
+ *   +- LED_CTRL          phones connected, status LED on
+ *      +- MOTOR_CONFIG   brightness buttons active
+ */
+typedef enum {
+	STATE_IDLE,
+	STATE_PERIPHERAL,
+	STATE_LED_CTRL,
+	STATE_MOTOR_CONFIG,
+	STATE_DEEP_IDLE,
+	STATE_ROOT,
+	STATE_COUNT,
+} ble_state_t;
+
+/*
+ * FSM events, posted from BT/GPIO context and consumed by the main thread.
+ * Bit numbers index the handler table; lower bits are dispatched first.
+ */
+enum fsm_event {
+	EVT_ADVERTISE,     // Bluetooth is up, start advertising
+	EVT_CONNECTED,     // a phone connected
+	EVT_CMD,           // commands waiting in the command queue
+	EVT_TAP,           // mode change from the sensor thread
+	EVT_GROUP,         // group sync command came due
+	EVT_BUTTON,        // brightness steps pending
+	EVT_DISCONNECTED,  // a phone disconnected
+	EVT_IDLE,          // dark and disconnected for a while
+	EVT_COUNT,
+};
+
+#define FSM_EVT_ADVERTISE    BIT(EVT_ADVERTISE)
+#define FSM_EVT_CONNECTED    BIT(EVT_CONNECTED)
+#define FSM_EVT_CMD          BIT(EVT_CMD)
+#define FSM_EVT_TAP          BIT(EVT_TAP)
+#define FSM_EVT_GROUP        BIT(EVT_GROUP)
+#define FSM_EVT_BUTTON       BIT(EVT_BUTTON)
+#define FSM_EVT_DISCONNECTED BIT(EVT_DISCONNECTED)
+#define FSM_EVT_IDLE         BIT(EVT_IDLE)
+#define FSM_EVT_ALL          BIT_MASK(EVT_COUNT)
+
+/** Drives the status LED: on while in STATE_LED_CTRL or below */
+typedef void (*app_fsm_led_cb_t)(bool on);
+
+/**
+ * @brief Put the FSM in STATE_IDLE.
+ *
+ * Call before any event is posted. @p led may be NULL.
+ */
+void app_fsm_init(app_fsm_led_cb_t led);
+
+/** Post FSM_EVT_* bits for the FSM thread; any context */
+void app_fsm_post(uint32_t events);
+
+/**
+ * @brief Count a phone in or out and post FSM_EVT_CONNECTED or
+ * FSM_EVT_DISCONNECTED.
+ *
+ * @return the phones connected now.
+ */
+unsigned int app_fsm_phone(bool connected);
+
+/** motor_init() callback: turns a tap batch into a mode change */
+void app_fsm_taps(const struct tap_event *taps, size_t n);
+
+/** The current FSM state, never STATE_ROOT; FSM thread only */
+ble_state_t app_fsm_state(void);
+
+/**
+ * @brief Run the FSM on the events posted so far, as one main loop wakeup.
+ *
+ * Handlers may post further events; those wait for the next call.
+ *
+ * @return the events handled, 0 if none were posted.
+ */
+uint32_t app_fsm_poll(void);
+
+/** The main loop: sleeps until events are posted and polls. Never returns. */
+void app_fsm_run(void);
+
+/**
+ * @brief Decode one control write and queue it for the FSM.
+ *
+ * The GATT write callback's body, without the connection: @p peer is the
+ * writer's connection index. Posts FSM_EVT_CMD once the command is queued.
+ *
+ * @return @p len, or a BT_GATT_ERR() code for the phone.
+ */
+ssize_t app_cmd_write(uint8_t peer, enum app_cmd_type type, const void *buf,
+		      uint16_t len, uint16_t offset);
+
+#if defined(CONFIG_SAMPLE_CMD_EMUL)
+/** Start queueing an LED write every CONFIG_SAMPLE_CMD_EMUL_PERIOD_MS */
+void app_cmd_emul_start(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // APP_FSM_H
@@ -0,0 +1,176 @@
+/*
+ * Persistent app state on top of Zephyr settings (NVS backend).
+ *
+ * Saves are deferred to the system work queue. The first change in a
+ * burst starts the timer and later ones only overwrite the pending value,
+ * so the flash sees at most one write per CONFIG_SAMPLE_SETTINGS_SAVE_DELAY_MS
+ * however fast the phone sends commands. Values equal to what is already
+ * stored are never written.
+ *
+ * Each LED zone has its own record: "app/led" for the whole strip, as
+ * before zones existed, and "app/led/<n>" for zone n. A zone that shows
+ * the whole strip's command has no record.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(app_settings, LOG_LEVEL_INF);
+
+#include "app_settings.h"
+
+#define SUBTREE "app"
+#define KEY_LED "led"
+#define KEY_LEN sizeof(SUBTREE "/" KEY_LED "/255")
+
+static struct k_spinlock lock;
+static led_cmd_t stored[LED_ZONES];  // what flash holds, or the boot default
+static uint32_t stored_own;          // zones with a record
+static bool stored_valid;
+static led_cmd_t pending[LED_ZONES];
+static uint32_t pending_own;
+
+static uint32_t saves;
+static uint32_t coalesced;
+
+static void save_fn(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(save_work, save_fn);
+
+static int app_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	const char *next;
+	unsigned long zone = 0;
+
+	if (!settings_name_steq(name, KEY_LED, &next)) {
+		return -ENOENT;
+	}
+	if (next) {
+		zone = strtoul(next, NULL, 10);
+		if (zone == 0 || zone >= LED_ZONES) {
+			return 0; // a zone this board does not have, keep it for others
+		}
+	}
+
+	if (len != sizeof(stored[0])) {
+		return -EINVAL;
+	}
+	if (read_cb(cb_arg, &stored[zone], sizeof(stored[0])) != sizeof(stored[0])) {
+		return -EIO;
+	}
+	stored_own |= BIT(zone);
+	stored_valid = true;
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(app, SUBTREE, NULL, app_set, NULL, NULL);
+
+uint32_t app_settings_load(led_cmd_t led[LED_ZONES])
+{
+	int err = settings_subsys_init();
+	uint32_t own;
+
+	if (err) {
+		LOG_ERR("Settings init failed (%d)", err);
+		return 0;
+	}
+
+	settings_load_subtree(SUBTREE);
+	own = stored_own;
+	if (!(own & BIT(0))) {
+		// nothing saved for the strip: the boot default needs no write either
+		stored[0] = led[0];
+		stored_own |= BIT(0);
+	}
+	stored_valid = true;
+	memcpy(led, stored, sizeof(stored));
+	memcpy(pending, stored, sizeof(stored));
+	pending_own = stored_own;
+	return own;
+}
+
+/* A zone's record differs: one of them has none, or they hold other commands */
+static bool zone_differs(bool own_a, const led_cmd_t *a, bool own_b, const led_cmd_t *b)
+{
+	return own_a != own_b || (own_a && memcmp(a, b, sizeof(*a)) != 0);
+}
+
+void app_settings_save_led(uint8_t zone, const led_cmd_t *led)
+{
+	k_spinlock_key_t key;
+	bool busy;
+
+	if (zone >= LED_ZONES) {
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+	busy = k_work_delayable_is_pending(&save_work);
+
+	// compare against what will end up in flash
+	if (busy ? !zone_differs(led != NULL, led, pending_own & BIT(zone), &pending[zone]) :
+		   stored_valid &&
+		   !zone_differs(led != NULL, led, stored_own & BIT(zone), &stored[zone])) {
+		k_spin_unlock(&lock, key);
+		return;
+	}
+
+	if (led) {
+		pending[zone] = *led;
+	}
+	WRITE_BIT(pending_own, zone, led != NULL);
+	k_spin_unlock(&lock, key);
+
+	// no-op while a save is pending, which is what coalesces the burst
+	if (k_work_schedule(&save_work, K_MSEC(CONFIG_SAMPLE_SETTINGS_SAVE_DELAY_MS)) == 0) {
+		coalesced++;
+	}
+}
+
+static void led_key(char *buf, uint8_t zone)
+{
+	if (zone == 0) {
+		strcpy(buf, SUBTREE "/" KEY_LED);
+	} else {
+		snprintf(buf, KEY_LEN, SUBTREE "/" KEY_LED "/%u", zone);
+	}
+}
+
+static void save_fn(struct k_work *work)
+{
+	for (uint8_t z = 0; z < LED_ZONES; z++) {
+		k_spinlock_key_t key = k_spin_lock(&lock);
+		led_cmd_t led = pending[z];
+		bool own = pending_own & BIT(z);
+		bool same = stored_valid && !zone_differs(own, &pending[z],
+							   stored_own & BIT(z), &stored[z]);
+		char name[KEY_LEN];
+		int err;
+
+		k_spin_unlock(&lock, key);
+
+		if (same) {
+			continue; // the burst ended where it started
+		}
+
+		led_key(name, z);
+		err = own ? settings_save_one(name, &led, sizeof(led)) : settings_delete(name);
+		if (err) {
+			LOG_ERR("Saving LED state of zone %u failed (%d)", z, err);
+			continue;
+		}
+
+		key = k_spin_lock(&lock);
+		stored[z] = led;
+		WRITE_BIT(stored_own, z, own);
+		k_spin_unlock(&lock, key);
+
+		saves++;
+	}
+	LOG_DBG("LED state saved (%u writes, %u coalesced)", saves, coalesced);
+}
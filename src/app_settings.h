@@ -0,0 +1,34 @@
+#ifndef APP_SETTINGS_H
+#define APP_SETTINGS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "led_strip_src/led_strip.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Load the persisted state. Call before bt_enable() so the strip
+ * can be painted straight away.
+ *
+ * @param led In: the boot default in led[0]. Out: the stored command of
+ * every zone in the returned mask; the others are untouched.
+ * @return Bit per zone with a stored command, bit 0 for the whole strip.
+ */
+uint32_t app_settings_load(led_cmd_t led[LED_ZONES]);
+
+/**
+ * @brief Persist the command of LED zone @p zone, or NULL once the zone
+ * just shows the whole strip again. Cheap enough to call after every
+ * change: unchanged values are ignored and a burst of changes ends up as
+ * at most one flash write per zone per CONFIG_SAMPLE_SETTINGS_SAVE_DELAY_MS.
+ */
+void app_settings_save_led(uint8_t zone, const led_cmd_t *led);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // APP_SETTINGS_H
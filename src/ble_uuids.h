@@ -8,11 +8,19 @@
 #define BT_UUID_LED_CONTROL_CHAR_VAL        BT_UUID_128_ENCODE(0x534C4220, 0x4441, 0x4E54, 0x494E, 0x4F0000001001)
 #define BT_UUID_MOTOR_CHAR_VAL              BT_UUID_128_ENCODE(0x534C4220, 0x4441, 0x4E54, 0x494E, 0x4F0000001002)
 #define BT_UUID_MOTOR_CONFIG_CHAR_VAL       BT_UUID_128_ENCODE(0x534C4220, 0x4441, 0x4E54, 0x494E, 0x4F0000001003)
+#define BT_UUID_PIXEL_STREAM_CHAR_VAL       BT_UUID_128_ENCODE(0x534C4220, 0x4441, 0x4E54, 0x494E, 0x4F0000001004)
+#define BT_UUID_TELEMETRY_CHAR_VAL          BT_UUID_128_ENCODE(0x534C4220, 0x4441, 0x4E54, 0x494E, 0x4F0000001005)
+#define BT_UUID_DIAG_SERVICE_VAL            BT_UUID_128_ENCODE(0x534C4220, 0x4441, 0x4E54, 0x494E, 0x4F0000002000)
+#define BT_UUID_DIAG_CHAR_VAL               BT_UUID_128_ENCODE(0x534C4220, 0x4441, 0x4E54, 0x494E, 0x4F0000002001)
 
 // Structs for binding
 static struct bt_uuid_128 control_service_uuid     = BT_UUID_INIT_128(BT_UUID_CONTROL_SERVICE_VAL);
 static struct bt_uuid_128 led_char_uuid             = BT_UUID_INIT_128(BT_UUID_LED_CONTROL_CHAR_VAL);
 static struct bt_uuid_128 motor_char_uuid           = BT_UUID_INIT_128(BT_UUID_MOTOR_CHAR_VAL);
 static struct bt_uuid_128 motor_config_char_uuid    = BT_UUID_INIT_128(BT_UUID_MOTOR_CONFIG_CHAR_VAL);
+static struct bt_uuid_128 pixel_stream_char_uuid    = BT_UUID_INIT_128(BT_UUID_PIXEL_STREAM_CHAR_VAL);
+static struct bt_uuid_128 telemetry_char_uuid       = BT_UUID_INIT_128(BT_UUID_TELEMETRY_CHAR_VAL);
+static struct bt_uuid_128 diag_service_uuid         = BT_UUID_INIT_128(BT_UUID_DIAG_SERVICE_VAL);
+static struct bt_uuid_128 diag_char_uuid            = BT_UUID_INIT_128(BT_UUID_DIAG_CHAR_VAL);
 
 #endif /* BLE_UUIDS_H */
\ No newline at end of file
@@ -0,0 +1,409 @@
+/*
+ * Central role: find sibling units and keep a link to them.
+ *
+ * Scanning is duty cycled (CONFIG_SAMPLE_SCAN_WINDOW_MS out of every
+ * CONFIG_SAMPLE_SCAN_INTERVAL_MS). Every report goes through a parser that
+ * walks the AD structures in place and only looks for the control service
+ * UUID, so nothing is copied or formatted per advertiser. Matches land in
+ * a small deduplicated cache with smoothed RSSI; a sibling is connected
+ * once it is close enough.
+ *
+ * Siblings we have linked to go on the controller's filter accept list.
+ * Once CONFIG_SAMPLE_CENTRAL_MAX_SIBLINGS are known, scans for reconnects
+ * only report those addresses, which keeps the host quiet in busy rooms.
+ *
+ * The scanner is shared with group_sync.c through src/scan_mgr.c: this
+ * module only requests and releases its own scan, and holds the scanner
+ * off while it creates a connection.
+ *
+ * Both ends of a pair scan, so only the unit with the lower address
+ * initiates; the other one just accepts the connection. An inbound link
+ * is a sibling's when its peer is in the cache, i.e. was seen advertising
+ * the control service; it is linked like an outbound one. The rest of the
+ * app tells phones from siblings through central_is_phone().
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(central, LOG_LEVEL_INF);
+
+#include "central.h"
+#include "ble_uuids.h"
+#include "ad_parse.h"
+#include "scan_mgr.h"
+
+#define SCAN_UNITS(ms) ((ms) * 8 / 5)  // 0.625 ms units
+#define RSSI_SHIFT 2                   // EWMA weight 1/4
+#define RSSI_NONE INT16_MIN
+
+BUILD_ASSERT(CONFIG_SAMPLE_SCAN_WINDOW_MS <= CONFIG_SAMPLE_SCAN_INTERVAL_MS,
+	     "scan window longer than scan interval");
+
+struct sibling {
+	bt_addr_le_t addr;
+	int16_t rssi;         // smoothed, dBm << RSSI_SHIFT
+	uint32_t last_seen;   // uptime ms
+	bool accepted;        // on the filter accept list
+};
+
+static struct sibling cache[CONFIG_SAMPLE_CENTRAL_CACHE_SIZE];
+static size_t cache_len;
+static size_t accepted;
+static struct k_spinlock cache_lock;  // cache addresses, read from any thread
+
+/* bit per bt_conn_index(), until the connection object is recycled */
+static atomic_t classified;
+static atomic_t sibling_conns;
+
+static struct bt_conn *links[CONFIG_SAMPLE_CENTRAL_MAX_SIBLINGS];
+static struct bt_conn *connecting;
+static central_link_cb_t link_cb;
+
+static const uint8_t control_uuid[] = { BT_UUID_CONTROL_SERVICE_VAL };
+
+/* scan-to-connect and duty cycle bookkeeping, all in uptime ms */
+static bool scanning;
+static int64_t scan_started;
+static int64_t scan_time;
+static uint32_t scan_reports;
+static uint32_t connect_ms_last;
+static uint32_t connect_ms_max;
+
+static int scan_start(void);
+
+/* Find or insert addr; evicts the oldest unlinked entry when full */
+static struct sibling *cache_get(const bt_addr_le_t *addr)
+{
+	k_spinlock_key_t key = k_spin_lock(&cache_lock);
+	struct sibling *oldest = NULL;
+
+	for (size_t i = 0; i < cache_len; i++) {
+		if (bt_addr_le_eq(&cache[i].addr, addr)) {
+			k_spin_unlock(&cache_lock, key);
+			return &cache[i];
+		}
+		if (!cache[i].accepted &&
+		    (oldest == NULL || cache[i].last_seen < oldest->last_seen)) {
+			oldest = &cache[i];
+		}
+	}
+
+	if (cache_len < ARRAY_SIZE(cache)) {
+		oldest = &cache[cache_len++];
+	} else if (oldest == NULL) {
+		k_spin_unlock(&cache_lock, key);
+		return NULL; // every entry is a linked sibling
+	}
+
+	bt_addr_le_copy(&oldest->addr, addr);
+	oldest->rssi = RSSI_NONE;
+	oldest->accepted = false;
+	k_spin_unlock(&cache_lock, key);
+	return oldest;
+}
+
+static bool cache_has(const bt_addr_le_t *addr)
+{
+	k_spinlock_key_t key = k_spin_lock(&cache_lock);
+	bool found = false;
+
+	for (size_t i = 0; i < cache_len && !found; i++) {
+		found = bt_addr_le_eq(&cache[i].addr, addr);
+	}
+	k_spin_unlock(&cache_lock, key);
+	return found;
+}
+
+static size_t link_count(void)
+{
+	size_t n = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+		n += links[i] != NULL;
+	}
+	return n;
+}
+
+static bool is_linked(const bt_addr_le_t *addr)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+		if (links[i] && bt_addr_le_eq(bt_conn_get_dst(links[i]), addr)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Only the lower address of a pair initiates */
+static bool we_initiate(const bt_addr_le_t *peer)
+{
+	bt_addr_le_t id[CONFIG_BT_ID_MAX];
+	size_t count = ARRAY_SIZE(id);
+
+	bt_id_get(id, &count);
+	return count && bt_addr_le_cmp(&id[BT_ID_DEFAULT], peer) < 0;
+}
+
+static void scan_stop(void)
+{
+	if (scanning) {
+		scan_mgr_release(SCAN_USER_CENTRAL);
+		scanning = false;
+		scan_time += k_uptime_get() - scan_started;
+	}
+}
+
+static void device_found(const struct bt_le_scan_recv_info *info, struct net_buf_simple *ad)
+{
+	const bt_addr_le_t *addr = info->addr;
+	int8_t rssi = info->rssi;
+	struct sibling *sib;
+	int err;
+
+	scan_reports++;
+
+	if (info->adv_type != BT_GAP_ADV_TYPE_ADV_IND || !ad_has_uuid128(ad, control_uuid)) {
+		return;
+	}
+
+	sib = cache_get(addr);
+	if (sib == NULL) {
+		return;
+	}
+
+	sib->rssi = (sib->rssi == RSSI_NONE) ? (rssi << RSSI_SHIFT) :
+		    sib->rssi + rssi - (sib->rssi >> RSSI_SHIFT);
+	sib->last_seen = k_uptime_get_32();
+
+	if (connecting || link_count() == ARRAY_SIZE(links) || is_linked(addr) ||
+	    (sib->rssi >> RSSI_SHIFT) < CONFIG_SAMPLE_CENTRAL_MIN_RSSI ||
+	    !we_initiate(addr)) {
+		return;
+	}
+
+	// nobody may scan while the connection is created, group sync included
+	scan_stop();
+	scan_mgr_hold(true);
+	err = bt_conn_le_create(addr, BT_CONN_LE_CREATE_CONN, BT_LE_CONN_PARAM_DEFAULT,
+				&connecting);
+	if (err) {
+		LOG_WRN("Sibling connect failed (%d)", err);
+		connecting = NULL;
+		scan_mgr_hold(false);
+		scan_start();
+	}
+}
+
+static int scan_start(void)
+{
+	struct bt_le_scan_param param = {
+		.type = BT_LE_SCAN_TYPE_PASSIVE,
+		.options = BT_LE_SCAN_OPT_NONE, // repeats feed the RSSI average
+		.interval = SCAN_UNITS(CONFIG_SAMPLE_SCAN_INTERVAL_MS),
+		.window = SCAN_UNITS(CONFIG_SAMPLE_SCAN_WINDOW_MS),
+	};
+	int err;
+
+	if (link_count() == ARRAY_SIZE(links)) {
+		return 0; // nothing left to look for
+	}
+
+	// every sibling is known: just wait for the missing ones to return
+	if (accepted == ARRAY_SIZE(links)) {
+		param.options |= BT_LE_SCAN_OPT_FILTER_ACCEPT_LIST;
+	}
+
+	// reports arrive through scan_callbacks, also for group sync's scans
+	err = scan_mgr_request(SCAN_USER_CENTRAL, &param);
+	if (err) {
+		return err;
+	}
+
+	if (!scanning) {
+		scanning = true;
+		scan_started = k_uptime_get();
+	}
+	return 0;
+}
+
+bool central_is_sibling(struct bt_conn *conn)
+{
+	size_t idx = bt_conn_index(conn);
+	struct bt_conn_info info;
+	bool sibling;
+
+	if (atomic_test_bit(&classified, idx)) {
+		return atomic_test_bit(&sibling_conns, idx);
+	}
+	if (bt_conn_get_info(conn, &info)) {
+		return false;
+	}
+
+	// only this module initiates links, so the central role means a sibling
+	sibling = info.role == BT_CONN_ROLE_CENTRAL || cache_has(bt_conn_get_dst(conn));
+	atomic_set_bit_to(&sibling_conns, idx, sibling);
+	atomic_set_bit(&classified, idx);
+	return sibling;
+}
+
+static void links_add(struct bt_conn *conn)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+		if (links[i] == NULL) {
+			links[i] = conn;
+			return;
+		}
+	}
+}
+
+/* A sibling that initiated itself; it needs no accept list entry from us */
+static void inbound(struct bt_conn *conn)
+{
+	if (is_linked(bt_conn_get_dst(conn)) || link_count() == ARRAY_SIZE(links) ||
+	    !central_is_sibling(conn)) {
+		return;
+	}
+
+	links_add(bt_conn_ref(conn));
+	LOG_INF("Sibling linked, inbound");
+
+	if (link_cb) {
+		link_cb(link_count());
+	}
+	if (link_count() == ARRAY_SIZE(links)) {
+		scan_stop(); // nothing left to look for
+	}
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	struct sibling *sib;
+
+	if (conn != connecting) {
+		if (!err) {
+			inbound(conn);
+		}
+		return;
+	}
+	connecting = NULL;
+
+	if (err) {
+		LOG_WRN("Sibling connect failed (0x%02x)", err);
+		bt_conn_unref(conn);
+		scan_mgr_hold(false);
+		scan_start();
+		return;
+	}
+
+	links_add(conn); // keeps the reference from bt_conn_le_create()
+
+	connect_ms_last = k_uptime_get() - scan_started;
+	connect_ms_max = MAX(connect_ms_max, connect_ms_last);
+	LOG_INF("Sibling linked, scan-to-connect %u ms", connect_ms_last);
+
+	// accept list changes need scanning stopped, which the hold still does
+	sib = cache_get(bt_conn_get_dst(conn));
+	if (sib && !sib->accepted &&
+	    bt_le_filter_accept_list_add(bt_conn_get_dst(conn)) == 0) {
+		sib->accepted = true;
+		accepted++;
+	}
+	scan_mgr_hold(false);
+
+	if (link_cb) {
+		link_cb(link_count());
+	}
+	scan_start();
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+		if (links[i] == conn) {
+			links[i] = NULL;
+			bt_conn_unref(conn);
+			LOG_INF("Sibling lost (reason 0x%02x)", reason);
+			if (link_cb) {
+				link_cb(link_count());
+			}
+			scan_start();
+			return;
+		}
+	}
+}
+
+static void live_conn(struct bt_conn *conn, void *data)
+{
+	*(atomic_val_t *)data |= BIT(bt_conn_index(conn));
+}
+
+/* A connection object was freed: forget how its slot was classified */
+static void recycled(void)
+{
+	atomic_val_t live = 0;
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, live_conn, &live);
+	atomic_and(&classified, live);
+}
+
+BT_CONN_CB_DEFINE(central_conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.recycled = recycled,
+};
+
+#if defined(CONFIG_SAMPLE_CENTRAL_STATS)
+static void central_stats_report(struct k_work *work)
+{
+	static int64_t prev_uptime, prev_scan;
+	static uint32_t prev_reports;
+	int64_t now = k_uptime_get();
+	int64_t scan = scan_time + (scanning ? now - scan_started : 0);
+	uint32_t permille;
+
+	// time spent scanning, times the fraction of it the radio listens
+	permille = (scan - prev_scan) * 1000 * CONFIG_SAMPLE_SCAN_WINDOW_MS /
+		   CONFIG_SAMPLE_SCAN_INTERVAL_MS / MAX(now - prev_uptime, 1);
+
+	LOG_INF("Scan: radio duty %u.%u%%, %u reports, %u cached, %u linked, "
+		"scan-to-connect last %u ms max %u ms",
+		permille / 10, permille % 10, scan_reports - prev_reports,
+		cache_len, link_count(), connect_ms_last, connect_ms_max);
+
+	prev_uptime = now;
+	prev_scan = scan;
+	prev_reports = scan_reports;
+
+	k_work_schedule(k_work_delayable_from_work(work),
+			K_SECONDS(CONFIG_SAMPLE_CENTRAL_STATS_INTERVAL));
+}
+
+static K_WORK_DELAYABLE_DEFINE(stats_work, central_stats_report);
+#endif /* CONFIG_SAMPLE_CENTRAL_STATS */
+
+static struct bt_le_scan_cb scan_callbacks = {
+	.recv = device_found,
+};
+
+void central_init(central_link_cb_t cb)
+{
+	link_cb = cb;
+	bt_le_scan_cb_register(&scan_callbacks);
+}
+
+int central_start(void)
+{
+#if defined(CONFIG_SAMPLE_CENTRAL_STATS)
+	k_work_schedule(&stats_work, K_SECONDS(CONFIG_SAMPLE_CENTRAL_STATS_INTERVAL));
+#endif
+	LOG_INF("Scanning %u ms every %u ms for siblings",
+		CONFIG_SAMPLE_SCAN_WINDOW_MS, CONFIG_SAMPLE_SCAN_INTERVAL_MS);
+	return scan_start();
+}
@@ -0,0 +1,44 @@
+#ifndef CENTRAL_H
+#define CENTRAL_H
+
+#include <stdbool.h>
+#include <zephyr/bluetooth/conn.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Called from the BT thread when the number of sibling links changes */
+typedef void (*central_link_cb_t)(unsigned int links);
+
+/** @brief Register the link callback; call before bt_enable() */
+void central_init(central_link_cb_t cb);
+
+/** @brief Start duty-cycled scanning for siblings; after bt_enable() */
+int central_start(void);
+
+#if defined(CONFIG_SAMPLE_CENTRAL)
+/**
+ * @brief True for a link to another unit, whichever end initiated it: one
+ * we created, or an inbound one from a peer seen advertising the control
+ * service. Decided on the first call and kept for the life of the link.
+ */
+bool central_is_sibling(struct bt_conn *conn);
+#else
+static inline bool central_is_sibling(struct bt_conn *conn) { return false; }
+#endif
+
+/** @brief A phone's link: one made to us by a peer that is not a sibling */
+static inline bool central_is_phone(struct bt_conn *conn)
+{
+	struct bt_conn_info info;
+
+	return bt_conn_get_info(conn, &info) == 0 && info.role == BT_CONN_ROLE_PERIPHERAL &&
+	       !central_is_sibling(conn);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CENTRAL_H
@@ -0,0 +1,104 @@
+/*
+ * Bounded command queues between the BT RX thread and the FSM thread.
+ *
+ * All GATT write callbacks run on the BT RX thread and only the FSM thread
+ * consumes, so a single-producer/single-consumer ring per connection is
+ * enough and needs no lock. Giving every peer its own ring means one
+ * flooding phone fills only its own queue. When a ring is full the new
+ * command is dropped and counted; write_cb() decides whether the phone
+ * sees an error.
+ */
+
+#include <errno.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/spsc_lockfree.h>
+#include <zephyr/sys/util.h>
+
+#include "cmd_queue.h"
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_SAMPLE_CMD_QUEUE_SIZE));
+
+static struct app_cmd ring_bufs[CMD_QUEUE_PEERS][CONFIG_SAMPLE_CMD_QUEUE_SIZE];
+
+#define RING_INIT(i, _) SPSC_INITIALIZER(CONFIG_SAMPLE_CMD_QUEUE_SIZE, ring_bufs[i])
+
+static SPSC_DECLARE(cmd_ring, struct app_cmd) rings[CMD_QUEUE_PEERS] = {
+	LISTIFY(CMD_QUEUE_PEERS, RING_INIT, (,))
+};
+
+struct peer_stats {
+	atomic_t enqueued;
+	atomic_t dropped;
+	atomic_t high_water;
+};
+
+static struct peer_stats stats[CMD_QUEUE_PEERS];
+
+// peer served first by the next cmd_queue_get()
+static uint8_t next_peer;
+
+int cmd_queue_put(const struct app_cmd *cmd)
+{
+	struct peer_stats *s = &stats[cmd->peer];
+	struct app_cmd *slot = spsc_acquire(&rings[cmd->peer]);
+	atomic_val_t depth;
+
+	if (slot == NULL) {
+		atomic_inc(&s->dropped);
+		return -ENOBUFS;
+	}
+
+	*slot = *cmd;
+	spsc_produce(&rings[cmd->peer]);
+	atomic_inc(&s->enqueued);
+
+	depth = spsc_consumable(&rings[cmd->peer]);
+	if (depth > atomic_get(&s->high_water)) {
+		atomic_set(&s->high_water, depth);
+	}
+
+	return 0;
+}
+
+size_t cmd_queue_get(struct app_cmd *cmds, size_t max)
+{
+	size_t n = 0;
+	size_t idle = 0;  // consecutive peers with nothing queued
+
+	// one command per peer per round until max or all rings are empty
+	while (n < max && idle < CMD_QUEUE_PEERS) {
+		struct app_cmd *cmd = spsc_consume(&rings[next_peer]);
+
+		if (cmd == NULL) {
+			idle++;
+		} else {
+			cmds[n++] = *cmd;
+			spsc_release(&rings[next_peer]);
+			idle = 0;
+		}
+		next_peer = (next_peer + 1) % CMD_QUEUE_PEERS;
+	}
+
+	return n;
+}
+
+void cmd_queue_get_stats(int peer, struct cmd_queue_stats *out)
+{
+	*out = (struct cmd_queue_stats){ 0 };
+
+	for (int i = 0; i < CMD_QUEUE_PEERS; i++) {
+		if (peer >= 0 && peer != i) {
+			continue;
+		}
+		out->enqueued += atomic_get(&stats[i].enqueued);
+		out->dropped += atomic_get(&stats[i].dropped);
+		out->high_water = MAX(out->high_water, atomic_get(&stats[i].high_water));
+	}
+}
+
+size_t cmd_queue_peer_ram(void)
+{
+	return sizeof(ring_bufs[0]) + sizeof(rings[0]) + sizeof(stats[0]);
+}
@@ -0,0 +1,64 @@
+#ifndef CMD_QUEUE_H
+#define CMD_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "led_strip_src/led_strip.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** What a GATT write asked for, stored in the characteristic user_data */
+enum app_cmd_type {
+	APP_CMD_LED = 1,
+	APP_CMD_MOTOR,
+	APP_CMD_MOTOR_CFG,
+};
+
+/** LED zones arbitrated last-writer-wins; zone 0 is the whole strip */
+#define APP_LED_ZONES LED_ZONES
+
+/** One queue per connection, indexed by bt_conn_index() */
+#if defined(CONFIG_BT_MAX_CONN)
+#define CMD_QUEUE_PEERS CONFIG_BT_MAX_CONN
+#else
+#define CMD_QUEUE_PEERS 2  // images without Bluetooth, see tests/
+#endif
+
+/** A write parsed once in the BT RX thread */
+struct app_cmd {
+	uint8_t type;      // enum app_cmd_type
+	uint8_t peer;      // connection index of the writer
+	uint8_t zone;      // APP_CMD_LED only
+	led_cmd_t led;     // APP_CMD_LED only
+	uint32_t stamp;    // cycle count when the write arrived
+};
+
+/** Totals since boot, per connection slot or summed */
+struct cmd_queue_stats {
+	uint32_t enqueued;
+	uint32_t dropped;     // queue was full
+	uint32_t high_water;  // most commands waiting at once
+};
+
+/** @brief Queue a command on its peer's ring. Returns -ENOBUFS when full. */
+int cmd_queue_put(const struct app_cmd *cmd);
+
+/**
+ * @brief Take up to @p max commands, round-robin across peers so a busy
+ * peer cannot starve the others. Each peer's commands stay in order.
+ */
+size_t cmd_queue_get(struct app_cmd *cmds, size_t max);
+
+/** @brief Read the counters of one peer, or the sum when @p peer is negative */
+void cmd_queue_get_stats(int peer, struct cmd_queue_stats *out);
+
+/** @brief Bytes of command queue state added by each extra connection */
+size_t cmd_queue_peer_ram(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CMD_QUEUE_H
@@ -0,0 +1,351 @@
+/*
+ * Connection parameter policy.
+ *
+ * A link starts in the idle profile: long interval plus peripheral latency
+ * so the radio sleeps through most connection events. Command or stream
+ * traffic switches it to the fast profile (short interval, 2M PHY) until
+ * CONFIG_SAMPLE_CONN_IDLE_TIMEOUT_MS passes without traffic, or for as
+ * long as conn_policy_hold_fast() says so. Data length and ATT MTU are
+ * negotiated up once right after connecting.
+ *
+ * Link updates are HCI/L2CAP procedures that must not run on the BT RX
+ * thread, so they are done from the system work queue. The handlers take
+ * their own reference to the link: a disconnect may drop the context's
+ * while they run.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(conn_policy, LOG_LEVEL_INF);
+
+#include "conn_policy.h"
+#include "telemetry.h"
+
+#define IDLE_TIMEOUT K_MSEC(CONFIG_SAMPLE_CONN_IDLE_TIMEOUT_MS)
+
+static const struct bt_le_conn_param fast_param = BT_LE_CONN_PARAM_INIT(
+	CONFIG_SAMPLE_CONN_FAST_INTERVAL_MIN, CONFIG_SAMPLE_CONN_FAST_INTERVAL_MAX,
+	0, CONFIG_SAMPLE_CONN_SUPERVISION_TIMEOUT);
+
+static const struct bt_le_conn_param idle_param = BT_LE_CONN_PARAM_INIT(
+	CONFIG_SAMPLE_CONN_IDLE_INTERVAL, CONFIG_SAMPLE_CONN_IDLE_INTERVAL,
+	CONFIG_SAMPLE_CONN_IDLE_LATENCY, CONFIG_SAMPLE_CONN_SUPERVISION_TIMEOUT);
+
+struct conn_ctx {
+	struct bt_conn *conn;
+	atomic_t fast;       // fast profile requested
+	struct k_work burst_work;
+	struct k_work_delayable idle_work;
+	struct conn_policy_info info;
+};
+
+static struct conn_ctx ctxs[CONFIG_BT_MAX_CONN];
+static struct k_spinlock ctx_lock;  // ctxs[].conn
+static atomic_t cmd_latency_us;
+static atomic_t hold;
+
+static struct conn_ctx *ctx_get(struct bt_conn *conn)
+{
+	return &ctxs[bt_conn_index(conn)];
+}
+
+/* The context's link with a reference of its own, NULL once disconnected */
+static struct bt_conn *ctx_conn(struct conn_ctx *ctx)
+{
+	k_spinlock_key_t key = k_spin_lock(&ctx_lock);
+	struct bt_conn *conn = ctx->conn ? bt_conn_ref(ctx->conn) : NULL;
+
+	k_spin_unlock(&ctx_lock, key);
+	return conn;
+}
+
+static void publish(struct bt_conn *conn, struct conn_ctx *ctx)
+{
+	struct conn_policy_info le = {
+		.interval = sys_cpu_to_le16(ctx->info.interval),
+		.latency = sys_cpu_to_le16(ctx->info.latency),
+		.timeout = sys_cpu_to_le16(ctx->info.timeout),
+		.tx_phy = ctx->info.tx_phy,
+		.rx_phy = ctx->info.rx_phy,
+		.mtu = sys_cpu_to_le16(ctx->info.mtu),
+		.tx_len = sys_cpu_to_le16(ctx->info.tx_len),
+		.cmd_latency_us = sys_cpu_to_le32((uint32_t)atomic_get(&cmd_latency_us)),
+	};
+
+	telemetry_conn(conn, &le);
+}
+
+static void burst_fn(struct k_work *work)
+{
+	struct conn_ctx *ctx = CONTAINER_OF(work, struct conn_ctx, burst_work);
+	struct bt_conn *conn = ctx_conn(ctx);
+	int err;
+
+	if (conn == NULL) {
+		return;
+	}
+
+	err = bt_conn_le_param_update(conn, &fast_param);
+	if (err && err != -EALREADY) {
+		LOG_WRN("fast param request failed (%d)", err);
+	}
+
+	if (IS_ENABLED(CONFIG_BT_USER_PHY_UPDATE)) {
+		err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+		if (err) {
+			LOG_WRN("2M PHY request failed (%d)", err);
+		}
+	}
+	bt_conn_unref(conn);
+}
+
+static void idle_fn(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct conn_ctx *ctx = CONTAINER_OF(dwork, struct conn_ctx, idle_work);
+	struct bt_conn *conn;
+	int err;
+
+	if (atomic_get(&hold)) {
+		return;
+	}
+	conn = ctx_conn(ctx);
+	if (conn == NULL) {
+		return;
+	}
+
+	atomic_clear(&ctx->fast);
+	err = bt_conn_le_param_update(conn, &idle_param);
+	if (err && err != -EALREADY) {
+		LOG_WRN("idle param request failed (%d)", err);
+	}
+
+	// end of a burst, a good time to report how it went
+	publish(conn, ctx);
+	bt_conn_unref(conn);
+}
+
+void conn_policy_activity(struct bt_conn *conn)
+{
+	struct conn_ctx *ctx;
+
+	if (conn == NULL) {
+		return;
+	}
+
+	ctx = ctx_get(conn);
+	if (!atomic_set(&ctx->fast, 1)) {
+		k_work_submit(&ctx->burst_work);
+	}
+	k_work_reschedule(&ctx->idle_work, IDLE_TIMEOUT);
+}
+
+void conn_policy_hold_fast(bool on)
+{
+	k_spinlock_key_t key;
+	uint32_t live = 0;
+
+	if (atomic_set(&hold, on) == on) {
+		return;
+	}
+
+	// a disconnect may drop a context's link meanwhile, see ctx_conn()
+	key = k_spin_lock(&ctx_lock);
+	for (size_t i = 0; i < ARRAY_SIZE(ctxs); i++) {
+		if (ctxs[i].conn) {
+			live |= BIT(i);
+		}
+	}
+	k_spin_unlock(&ctx_lock, key);
+
+	for (size_t i = 0; i < ARRAY_SIZE(ctxs); i++) {
+		struct conn_ctx *ctx = &ctxs[i];
+
+		if (!(live & BIT(i))) {
+			continue;
+		}
+		if (on && !atomic_set(&ctx->fast, 1)) {
+			k_work_submit(&ctx->burst_work);
+		}
+		// released: the usual timeout from here, held: idle_fn backs off
+		k_work_reschedule(&ctx->idle_work, IDLE_TIMEOUT);
+	}
+}
+
+void conn_policy_cmd_latency(uint32_t us)
+{
+	uint32_t avg = (uint32_t)atomic_get(&cmd_latency_us);
+
+	// EWMA with 1/8 weight, seeded by the first sample
+	avg = avg ? avg - (avg >> 3) + (us >> 3) : us;
+	atomic_set(&cmd_latency_us, avg);
+}
+
+size_t conn_policy_peer_ram(void)
+{
+	return sizeof(ctxs[0]) + sizeof(struct bt_gatt_exchange_params);
+}
+
+static void mtu_exchanged(struct bt_conn *conn, uint8_t err,
+			  struct bt_gatt_exchange_params *params)
+{
+	if (err) {
+		LOG_WRN("MTU exchange failed (%u)", err);
+	}
+}
+
+static struct bt_gatt_exchange_params mtu_params[CONFIG_BT_MAX_CONN];
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	struct conn_ctx *ctx;
+	struct bt_conn_info info;
+	k_spinlock_key_t key;
+
+	if (err) {
+		return;
+	}
+
+	ctx = ctx_get(conn);
+	key = k_spin_lock(&ctx_lock);
+	ctx->conn = bt_conn_ref(conn);
+	k_spin_unlock(&ctx_lock, key);
+	atomic_clear(&ctx->fast);
+
+	// nothing of the previous link on this slot carries over
+	memset(&ctx->info, 0, sizeof(ctx->info));
+	if (bt_conn_get_info(conn, &info) == 0) {
+		ctx->info.interval = info.le.interval;
+		ctx->info.latency = info.le.latency;
+		ctx->info.timeout = info.le.timeout;
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+		ctx->info.tx_phy = info.le.phy->tx_phy;
+		ctx->info.rx_phy = info.le.phy->rx_phy;
+#endif
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+		ctx->info.tx_len = info.le.data_len->tx_max_len;
+#endif
+	}
+	ctx->info.mtu = bt_gatt_get_mtu(conn);
+
+	if (IS_ENABLED(CONFIG_BT_USER_DATA_LEN_UPDATE)) {
+		err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+		if (err) {
+			LOG_WRN("data length request failed (%d)", err);
+		}
+	}
+
+	mtu_params[bt_conn_index(conn)].func = mtu_exchanged;
+	err = bt_gatt_exchange_mtu(conn, &mtu_params[bt_conn_index(conn)]);
+	if (err) {
+		LOG_WRN("MTU exchange request failed (%d)", err);
+	}
+
+	// start in the low-power profile until traffic shows up
+	k_work_reschedule(&ctx->idle_work, IDLE_TIMEOUT);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	struct conn_ctx *ctx = ctx_get(conn);
+	struct bt_conn *prev;
+	k_spinlock_key_t key;
+
+	// a handler already running holds its own reference
+	k_work_cancel(&ctx->burst_work);
+	k_work_cancel_delayable(&ctx->idle_work);
+
+	key = k_spin_lock(&ctx_lock);
+	prev = ctx->conn;
+	ctx->conn = NULL;
+	k_spin_unlock(&ctx_lock, key);
+	if (prev) {
+		bt_conn_unref(prev);
+	}
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval,
+			     uint16_t latency, uint16_t timeout)
+{
+	struct conn_ctx *ctx = ctx_get(conn);
+
+	ctx->info.interval = interval;
+	ctx->info.latency = latency;
+	ctx->info.timeout = timeout;
+
+	LOG_INF("conn params: interval %u.%02u ms, latency %u, timeout %u ms",
+		interval * 125 / 100, (interval * 125) % 100, latency, timeout * 10);
+	publish(conn, ctx);
+}
+
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+static void le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+	struct conn_ctx *ctx = ctx_get(conn);
+
+	ctx->info.tx_phy = param->tx_phy;
+	ctx->info.rx_phy = param->rx_phy;
+
+	LOG_INF("PHY: tx %u rx %u", param->tx_phy, param->rx_phy);
+	publish(conn, ctx);
+}
+#endif
+
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+static void le_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+	struct conn_ctx *ctx = ctx_get(conn);
+
+	ctx->info.tx_len = info->tx_max_len;
+
+	LOG_INF("data length: tx %u rx %u octets", info->tx_max_len, info->rx_max_len);
+	publish(conn, ctx);
+}
+#endif
+
+BT_CONN_CB_DEFINE(conn_policy_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_param_updated = le_param_updated,
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+	.le_phy_updated = le_phy_updated,
+#endif
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+	.le_data_len_updated = le_data_len_updated,
+#endif
+};
+
+static void att_mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
+{
+	struct conn_ctx *ctx = ctx_get(conn);
+
+	ctx->info.mtu = MIN(tx, rx);
+
+	LOG_INF("ATT MTU: %u", ctx->info.mtu);
+	publish(conn, ctx);
+}
+
+static struct bt_gatt_cb gatt_callbacks = {
+	.att_mtu_updated = att_mtu_updated,
+};
+
+static int conn_policy_init(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(ctxs); i++) {
+		k_work_init(&ctxs[i].burst_work, burst_fn);
+		k_work_init_delayable(&ctxs[i].idle_work, idle_fn);
+	}
+
+	bt_gatt_cb_register(&gatt_callbacks);
+	return 0;
+}
+
+SYS_INIT(conn_policy_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,47 @@
+#ifndef CONN_POLICY_H
+#define CONN_POLICY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/bluetooth/conn.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Achieved link parameters, little endian on air */
+struct conn_policy_info {
+	uint16_t interval;        // 1.25 ms units
+	uint16_t latency;         // connection events
+	uint16_t timeout;         // 10 ms units
+	uint8_t tx_phy;           // BT_GAP_LE_PHY_*
+	uint8_t rx_phy;
+	uint16_t mtu;             // ATT MTU
+	uint16_t tx_len;          // LL payload octets
+	uint32_t cmd_latency_us;  // smoothed write-to-apply time
+} __packed;
+
+/**
+ * @brief Note traffic on a connection. Switches the link to the fast
+ * profile and restarts the idle timer. Safe from the BT RX thread.
+ */
+void conn_policy_activity(struct bt_conn *conn);
+
+/**
+ * @brief Keep every link in the fast profile, idle timeouts included,
+ * until called again with false. Used for firmware uploads.
+ */
+void conn_policy_hold_fast(bool on);
+
+/** @brief Bytes of link policy state added by each extra connection */
+size_t conn_policy_peer_ram(void);
+
+/** @brief Feed one measured write-to-apply latency, from the FSM thread */
+void conn_policy_cmd_latency(uint32_t us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONN_POLICY_H
@@ -0,0 +1,118 @@
+/*
+ * Firmware update over BLE: MCUboot plus the mcumgr SMP GATT transport.
+ *
+ * img_mgmt writes uploaded chunks to slot1 on the mcumgr work queue,
+ * which runs below the LED threads, so the strip and the FSM keep going
+ * during an upload. This module only watches the image events: it holds
+ * every link in the fast profile while an upload runs and logs progress
+ * and the achieved throughput.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/mgmt/mcumgr/mgmt/callbacks.h>
+#include <zephyr/mgmt/mcumgr/grp/img_mgmt/img_mgmt.h>
+#include <zephyr/mgmt/mcumgr/grp/img_mgmt/img_mgmt_callbacks.h>
+#if defined(CONFIG_BOOTLOADER_MCUBOOT)
+#include <zephyr/dfu/mcuboot.h>
+#endif
+LOG_MODULE_REGISTER(dfu, LOG_LEVEL_INF);
+
+#include "dfu.h"
+#include "conn_policy.h"
+
+#define PROGRESS_MS 1000
+
+static struct {
+	uint32_t size;      // image size, from the first chunk
+	uint32_t done;      // bytes received so far
+	int64_t start;      // uptime of the first chunk
+	int64_t reported;   // uptime of the last progress line
+} upload;
+
+/* Throughput in tenths of KiB/s */
+static uint32_t rate_x10(uint32_t bytes, int64_t ms)
+{
+	return ms > 0 ? (uint32_t)((uint64_t)bytes * 10000 / 1024 / ms) : 0;
+}
+
+static void report(const char *what)
+{
+	int64_t ms = k_uptime_get() - upload.start;
+	uint32_t rate = rate_x10(upload.done, ms);
+
+	LOG_INF("%s %u/%u B in %lld ms, %u.%u KB/s", what, upload.done,
+		upload.size, ms, rate / 10, rate % 10);
+}
+
+static enum mgmt_cb_return dfu_event(uint32_t event, enum mgmt_cb_return prev_status,
+				     int32_t *rc, uint16_t *group, bool *abort_more,
+				     void *data, size_t data_size)
+{
+	const struct img_mgmt_upload_check *chunk;
+
+	switch (event) {
+	case MGMT_EVT_OP_IMG_MGMT_DFU_STARTED:
+		upload.start = upload.reported = k_uptime_get();
+		upload.done = 0;
+		conn_policy_hold_fast(true);
+		LOG_INF("upload started");
+		break;
+	case MGMT_EVT_OP_IMG_MGMT_DFU_CHUNK:
+		chunk = data;
+		if (chunk->req->off == 0) {
+			upload.size = chunk->req->size;
+		}
+		upload.done = chunk->req->off + chunk->req->img_data.len;
+		if (k_uptime_get() - upload.reported >= PROGRESS_MS) {
+			upload.reported = k_uptime_get();
+			report("progress");
+		}
+		break;
+	case MGMT_EVT_OP_IMG_MGMT_DFU_PENDING:
+		// the whole image is in slot1, MCUboot swaps it in at the next reset
+		conn_policy_hold_fast(false);
+		report("done");
+		break;
+	case MGMT_EVT_OP_IMG_MGMT_DFU_STOPPED:
+		conn_policy_hold_fast(false);
+		report("stopped");
+		break;
+	default:
+		break;
+	}
+
+	return MGMT_CB_OK;
+}
+
+static struct mgmt_callback dfu_callback = {
+	.callback = dfu_event,
+	.event_id = MGMT_EVT_OP_IMG_MGMT_ALL,
+};
+
+void dfu_confirm(void)
+{
+#if defined(CONFIG_BOOTLOADER_MCUBOOT)
+	int err;
+
+	if (boot_is_img_confirmed()) {
+		return;
+	}
+
+	err = boot_write_img_confirmed();
+	if (err) {
+		LOG_ERR("confirming the image failed (%d)", err);
+		return;
+	}
+	LOG_INF("new image confirmed");
+#endif
+}
+
+static int dfu_init(void)
+{
+	mgmt_callback_register(&dfu_callback);
+	return 0;
+}
+
+SYS_INIT(dfu_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,22 @@
+#ifndef DFU_H
+#define DFU_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(CONFIG_SAMPLE_DFU)
+/**
+ * @brief Mark the running image good so MCUboot keeps it. Call once the
+ * application is known to work; until then a reset reverts an update.
+ */
+void dfu_confirm(void);
+#else
+static inline void dfu_confirm(void) {}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DFU_H
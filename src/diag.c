@@ -0,0 +1,178 @@
+/*
+ * Hot-path latency histograms and counters.
+ *
+ * Recording is a subtraction, a count-leading-zeros and a few atomic
+ * adds, safe from any context including ISRs. Memory is fixed: one
+ * struct diag_hist_data per histogram. The data is readable through the
+ * diagnostics characteristic and the "diag" shell command.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/shell/shell.h>
+
+#include "diag.h"
+#include "ble_uuids.h"
+
+#define DIAG_VERSION 1
+
+static const char *const hist_names[DIAG_H_COUNT] = {
+	[DIAG_H_WRITE_DISPATCH] = "write->dispatch",
+	[DIAG_H_WRITE_APPLY] = "write->apply",
+	[DIAG_H_APPLY_PIXELS] = "apply->pixels",
+	[DIAG_H_STRIP_TX] = "strip tx",
+	[DIAG_H_TAP_MODE] = "tap->mode",
+};
+
+static const char *const counter_names[DIAG_C_COUNT] = {
+	[DIAG_C_CMD_RX] = "cmds rx",
+	[DIAG_C_CMD_DROPPED] = "cmds dropped",
+	[DIAG_C_FRAMES_PUSHED] = "frames pushed",
+	[DIAG_C_FRAMES_SENT] = "frames sent",
+	[DIAG_C_TAPS] = "taps",
+};
+
+static struct k_spinlock lock;
+static struct diag_hist_data hists[DIAG_H_COUNT];
+static atomic_t counters[DIAG_C_COUNT];
+
+void diag_since(enum diag_hist h, uint32_t start)
+{
+	uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+	uint32_t b = MIN(us ? 32 - __builtin_clz(us) : 0, DIAG_BUCKETS - 1);
+	struct diag_hist_data *d = &hists[h];
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	d->count++;
+	d->sum_us += us;
+	d->max_us = MAX(d->max_us, us);
+	if (d->buckets[b] < UINT16_MAX) {
+		d->buckets[b]++;
+	}
+	k_spin_unlock(&lock, key);
+}
+
+void diag_count(enum diag_counter c)
+{
+	atomic_inc(&counters[c]);
+}
+
+void diag_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	memset(hists, 0, sizeof(hists));
+	k_spin_unlock(&lock, key);
+
+	for (int i = 0; i < DIAG_C_COUNT; i++) {
+		atomic_clear(&counters[i]);
+	}
+}
+
+/* [version][hists][buckets][counters], histograms, then uint32_t counters */
+struct diag_blob {
+	uint8_t version;
+	uint8_t n_hists;
+	uint8_t n_buckets;
+	uint8_t n_counters;
+	struct diag_hist_data hists[DIAG_H_COUNT];
+	uint32_t counters[DIAG_C_COUNT];
+} __packed;
+
+static ssize_t diag_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			 void *buf, uint16_t len, uint16_t offset)
+{
+	static struct diag_blob blob;
+	k_spinlock_key_t key;
+
+	// long reads come back with an offset, keep serving the same snapshot
+	if (offset == 0) {
+		blob.version = DIAG_VERSION;
+		blob.n_hists = DIAG_H_COUNT;
+		blob.n_buckets = DIAG_BUCKETS;
+		blob.n_counters = DIAG_C_COUNT;
+
+		key = k_spin_lock(&lock);
+		for (int i = 0; i < DIAG_H_COUNT; i++) {
+			blob.hists[i].count = sys_cpu_to_le32(hists[i].count);
+			blob.hists[i].sum_us = sys_cpu_to_le32(hists[i].sum_us);
+			blob.hists[i].max_us = sys_cpu_to_le32(hists[i].max_us);
+			for (int b = 0; b < DIAG_BUCKETS; b++) {
+				blob.hists[i].buckets[b] = sys_cpu_to_le16(hists[i].buckets[b]);
+			}
+		}
+		k_spin_unlock(&lock, key);
+
+		for (int i = 0; i < DIAG_C_COUNT; i++) {
+			blob.counters[i] = sys_cpu_to_le32(atomic_get(&counters[i]));
+		}
+	}
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &blob, sizeof(blob));
+}
+
+static ssize_t diag_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			  const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	// any write clears the data
+	diag_reset();
+	return len;
+}
+
+BT_GATT_SERVICE_DEFINE(diag_svc,
+	BT_GATT_PRIMARY_SERVICE(&diag_service_uuid),
+
+	BT_GATT_CHARACTERISTIC(&diag_char_uuid.uuid,
+	BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+	BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+	diag_read, diag_write, NULL),
+	BT_GATT_CUD("Diagnostics", BT_GATT_PERM_READ),
+);
+
+#if defined(CONFIG_SHELL)
+static int cmd_diag_show(const struct shell *sh, size_t argc, char **argv)
+{
+	struct diag_hist_data d;
+
+	for (int i = 0; i < DIAG_H_COUNT; i++) {
+		k_spinlock_key_t key = k_spin_lock(&lock);
+
+		d = hists[i];
+		k_spin_unlock(&lock, key);
+
+		shell_print(sh, "%-16s n %u avg %u us max %u us", hist_names[i], d.count,
+			    d.count ? d.sum_us / d.count : 0, d.max_us);
+		for (int b = 0; b < DIAG_BUCKETS; b++) {
+			if (d.buckets[b]) {
+				shell_print(sh, "  < %6u us: %u", BIT(b), d.buckets[b]);
+			}
+		}
+	}
+
+	for (int i = 0; i < DIAG_C_COUNT; i++) {
+		shell_print(sh, "%-16s %ld", counter_names[i], atomic_get(&counters[i]));
+	}
+
+	return 0;
+}
+
+static int cmd_diag_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	diag_reset();
+	shell_print(sh, "cleared");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(diag_cmds,
+	SHELL_CMD(show, NULL, "Print latency histograms and counters", cmd_diag_show),
+	SHELL_CMD(reset, NULL, "Clear histograms and counters", cmd_diag_reset),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(diag, &diag_cmds, "Hot path diagnostics", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,61 @@
+#ifndef DIAG_H
+#define DIAG_H
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Latency histograms, log2 buckets of microseconds */
+enum diag_hist {
+	DIAG_H_WRITE_DISPATCH,  // write_cb() to FSM dispatch
+	DIAG_H_WRITE_APPLY,     // write_cb() to the command being handled
+	DIAG_H_APPLY_PIXELS,    // animation start to its first frame on the strip
+	DIAG_H_STRIP_TX,        // one successful transfer to the strip
+	DIAG_H_TAP_MODE,        // sensor edge to the tap's mode change
+	DIAG_H_COUNT,
+};
+
+/** Event counters */
+enum diag_counter {
+	DIAG_C_CMD_RX,          // commands queued by write_cb()
+	DIAG_C_CMD_DROPPED,     // commands lost to a full queue
+	DIAG_C_FRAMES_PUSHED,   // frames handed to the tx queue
+	DIAG_C_FRAMES_SENT,     // transfers completed
+	DIAG_C_TAPS,            // taps handled by the sensor thread
+	DIAG_C_COUNT,
+};
+
+#define DIAG_BUCKETS 16  // bucket i: [2^(i-1), 2^i) us, the last one open ended
+
+/** One histogram as read over GATT, little endian */
+struct diag_hist_data {
+	uint32_t count;
+	uint32_t sum_us;
+	uint32_t max_us;
+	uint16_t buckets[DIAG_BUCKETS];  // saturate at UINT16_MAX
+} __packed;
+
+#if defined(CONFIG_SAMPLE_DIAG)
+/** @brief Record the time since @p start (k_cycle_get_32()) */
+void diag_since(enum diag_hist h, uint32_t start);
+
+/** @brief Count one event */
+void diag_count(enum diag_counter c);
+
+/** @brief Clear every histogram and counter */
+void diag_reset(void);
+#else
+/* Compiled out: no code, no data */
+static inline void diag_since(enum diag_hist h, uint32_t start) {}
+static inline void diag_count(enum diag_counter c) {}
+static inline void diag_reset(void) {}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DIAG_H
@@ -0,0 +1,169 @@
+/*
+ * Binary trace of the app state machine.
+ *
+ * Every dispatched event adds an 8-byte record to a ring of
+ * CONFIG_SAMPLE_FSM_TRACE_LEN entries, and bumps a from/to transition
+ * count and the per-event handler time. Only the FSM thread writes, so
+ * there is no locking; the shell reads a possibly torn last record.
+ *
+ * The trace lives in __noinit RAM. After a warm reset (watchdog, fault,
+ * sys_reboot) the tail of the previous boot's trace is printed before a
+ * new one starts, which shows what the FSM was doing when it died.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/shell/shell.h>
+
+#include "fsm_trace.h"
+
+#define TRACE_LEN   CONFIG_SAMPLE_FSM_TRACE_LEN
+#define BOOT_DUMP   8           // records of the previous boot to print
+
+/* "FSMT" with the layout folded in, so a trace left by other firmware is not trusted */
+#define TRACE_MAGIC ((uint32_t)(0x46534D54 ^ (sizeof(struct fsm_trace) << 8) ^ TRACE_LEN))
+
+struct event_time {
+	uint32_t count;
+	uint32_t sum_us;
+	uint32_t max_us;
+};
+
+struct fsm_trace {
+	uint32_t magic;
+	uint32_t head;      // total records written
+	struct fsm_trace_rec ring[TRACE_LEN];
+	uint16_t transitions[FSM_TRACE_STATES][FSM_TRACE_STATES];
+	struct event_time events[FSM_TRACE_EVENTS];
+};
+
+static __noinit struct fsm_trace trace;
+
+static const char *const *state_names;
+static const char *const *event_names;
+static uint8_t n_states;
+static uint8_t n_events;
+
+/* A record the names cover; the previous boot's may be garbage */
+static bool rec_valid(const struct fsm_trace_rec *r)
+{
+	return r->event < n_events && (r->states >> 4) < n_states &&
+	       (r->states & 0x0F) < n_states;
+}
+
+static void print_rec(const struct shell *sh, const struct fsm_trace_rec *r)
+{
+	const char *from = state_names[r->states >> 4];
+	const char *to = state_names[r->states & 0x0F];
+	const char *evt = event_names[r->event];
+
+	if (sh) {
+		shell_print(sh, "%10u ms %-12s %-12s -> %-12s %5u us", r->time_ms, evt, from,
+			    to, r->run_us);
+	} else {
+		printk("%10u ms %-12s %-12s -> %-12s %5u us\n", r->time_ms, evt, from, to,
+		       r->run_us);
+	}
+}
+
+void fsm_trace_init(const char *const *states, uint8_t states_len,
+		    const char *const *events, uint8_t events_len)
+{
+	state_names = states;
+	event_names = events;
+	n_states = MIN(states_len, FSM_TRACE_STATES);
+	n_events = MIN(events_len, FSM_TRACE_EVENTS);
+
+	if (trace.magic == TRACE_MAGIC && trace.head > 0) {
+		uint32_t n = MIN(trace.head, BOOT_DUMP);
+
+		printk("FSM trace from the previous boot, last %u of %u:\n", n, trace.head);
+		for (uint32_t i = trace.head - n; i < trace.head; i++) {
+			const struct fsm_trace_rec *r = &trace.ring[i % TRACE_LEN];
+
+			if (rec_valid(r)) {
+				print_rec(NULL, r);
+			}
+		}
+	}
+
+	memset(&trace, 0, sizeof(trace));
+	trace.magic = TRACE_MAGIC;
+}
+
+void fsm_trace_record(uint8_t event, uint8_t from, uint8_t to, uint32_t cycles)
+{
+	uint32_t us = k_cyc_to_us_floor32(cycles);
+	struct fsm_trace_rec *r = &trace.ring[trace.head % TRACE_LEN];
+	struct event_time *e = &trace.events[event];
+
+	r->time_ms = k_uptime_get_32();
+	r->run_us = MIN(us, UINT16_MAX);
+	r->event = event;
+	r->states = (from << 4) | to;
+	trace.head++;
+
+	if (trace.transitions[from][to] < UINT16_MAX) {
+		trace.transitions[from][to]++;
+	}
+	e->count++;
+	e->sum_us += us;
+	e->max_us = MAX(e->max_us, us);
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_fsm_trace(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t head = trace.head;
+	uint32_t n = MIN(head, TRACE_LEN);
+
+	shell_print(sh, "last %u of %u events", n, head);
+	for (uint32_t i = head - n; i < head; i++) {
+		print_rec(sh, &trace.ring[i % TRACE_LEN]);
+	}
+	return 0;
+}
+
+static int cmd_fsm_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "transitions:");
+	for (int from = 0; from < n_states; from++) {
+		for (int to = 0; to < n_states; to++) {
+			if (trace.transitions[from][to] && from != to) {
+				shell_print(sh, "  %-12s -> %-12s %u", state_names[from],
+					    state_names[to], trace.transitions[from][to]);
+			}
+		}
+	}
+
+	shell_print(sh, "handlers:");
+	for (int i = 0; i < n_events; i++) {
+		const struct event_time *e = &trace.events[i];
+
+		if (e->count) {
+			shell_print(sh, "  %-12s n %u avg %u us max %u us", event_names[i],
+				    e->count, e->sum_us / e->count, e->max_us);
+		}
+	}
+	return 0;
+}
+
+static int cmd_fsm_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	memset(&trace, 0, sizeof(trace));
+	trace.magic = TRACE_MAGIC;
+	shell_print(sh, "cleared");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(fsm_cmds,
+	SHELL_CMD(trace, NULL, "Print the recent events and transitions", cmd_fsm_trace),
+	SHELL_CMD(stats, NULL, "Print transition counts and handler times", cmd_fsm_stats),
+	SHELL_CMD(reset, NULL, "Clear the trace", cmd_fsm_reset),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(fsm, &fsm_cmds, "State machine trace", NULL);
+#endif /* CONFIG_SHELL */
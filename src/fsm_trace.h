@@ -0,0 +1,45 @@
+#ifndef FSM_TRACE_H
+#define FSM_TRACE_H
+
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FSM_TRACE_STATES 8   // state numbers must be below this
+#define FSM_TRACE_EVENTS 8   // event bit numbers must be below this
+
+/** One dispatched event, 8 bytes */
+struct fsm_trace_rec {
+	uint32_t time_ms;    // uptime, wraps after 49 days
+	uint16_t run_us;     // time spent handling it, saturates
+	uint8_t event;       // event bit number
+	uint8_t states;      // state before << 4 | state after
+} __packed;
+
+#if defined(CONFIG_SAMPLE_FSM_TRACE)
+/**
+ * @brief Name states and events for the shell and the boot dump. Prints
+ * the tail of the previous boot's trace if it survived a warm reset,
+ * then starts a new one. Call before the first fsm_trace_record().
+ * Records naming a state or event past the arrays are not printed.
+ */
+void fsm_trace_init(const char *const *states, uint8_t states_len,
+		    const char *const *events, uint8_t events_len);
+
+/** @brief Record one dispatch; FSM thread only */
+void fsm_trace_record(uint8_t event, uint8_t from, uint8_t to, uint32_t cycles);
+#else
+static inline void fsm_trace_init(const char *const *states, uint8_t states_len,
+				  const char *const *events, uint8_t events_len) {}
+static inline void fsm_trace_record(uint8_t event, uint8_t from, uint8_t to,
+				    uint32_t cycles) {}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FSM_TRACE_H
@@ -0,0 +1,359 @@
+/*
+ * Connectionless group sync over extended/periodic advertising.
+ *
+ * A unit that receives an LED command from a phone becomes the group
+ * broadcaster. Its periodic advertising train carries the command, a
+ * sequence number and the time the command applies, both in the
+ * broadcaster's uptime (the group timebase). The same train carries the
+ * broadcaster's current time, refreshed twice per periodic interval.
+ *
+ * Receivers find the train via the control service UUID in the extended
+ * advertising data, sync to it, and stop caring about connections. For
+ * each report they take (remote time - local time). The remote stamp is
+ * set at most one interval before it goes on air, so the largest sample in
+ * a window is closest to the true offset. The window maximum is used as
+ * the offset, and a new window follows drift between crystals.
+ *
+ * Every unit, the broadcaster included, applies a command at the same
+ * group time, CONFIG_SAMPLE_GROUP_SYNC_LEAD_MS after it was published.
+ * This leaves room for a few lost periodic packets. Skew between units is
+ * bounded by the receive jitter, not by the number of units.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/gap.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(group_sync, LOG_LEVEL_INF);
+
+#include "group_sync.h"
+#include "ble_uuids.h"
+#include "ad_parse.h"
+#include "scan_mgr.h"
+
+#define MSG_VERSION 1
+#define COMPANY_ID_TEST 0xFFFF  // Bluetooth SIG test company ID
+#define PER_ADV_UNITS(ms) ((ms) * 4 / 5)  // 1.25 ms units
+#define SYNC_TIMEOUT_UNITS(ms) ((ms) / 10) // 10 ms units
+
+BUILD_ASSERT(CONFIG_SAMPLE_GROUP_SYNC_LEAD_MS >= 3 * CONFIG_SAMPLE_GROUP_SYNC_INTERVAL_MS,
+	     "lead time must cover a few lost periodic packets");
+
+/* Periodic advertising payload, little endian */
+struct group_msg {
+	uint16_t company;
+	uint8_t version;
+	uint8_t group;
+	uint8_t seq;
+	uint32_t now_ms;      // broadcaster time when the data was set
+	uint32_t apply_ms;    // group time the command applies at
+	led_cmd_t led;
+} __packed;
+
+static group_sync_cb_t due_cb;
+
+static struct k_spinlock lock;
+static led_cmd_t due_cmd;
+static bool due_pending;
+static led_cmd_t sched_cmd;
+
+static void due_fn(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(due_work, due_fn);
+
+/* Broadcaster; the train's data is only set with tx_lock held */
+static K_MUTEX_DEFINE(tx_lock);
+static struct bt_le_ext_adv *adv;
+static struct group_msg tx_msg;
+
+static void timebase_fn(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(timebase_work, timebase_fn);
+
+/* Receiver */
+static struct bt_le_per_adv_sync *sync;
+static uint8_t rx_seq;
+static bool rx_seq_valid;
+static int64_t offset_ms;         // group time - local uptime
+static int64_t window_max;
+static uint32_t window_len;
+static bool offset_valid;
+
+static const uint8_t control_uuid[] = { BT_UUID_CONTROL_SERVICE_VAL };
+
+static const struct bt_data ext_ad[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, BT_LE_AD_NO_BREDR),
+	BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_CONTROL_SERVICE_VAL),
+};
+
+/* Schedule cmd at local uptime when_ms, replacing anything pending */
+static void schedule(const led_cmd_t *cmd, int64_t when_ms)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	sched_cmd = *cmd;
+	k_spin_unlock(&lock, key);
+
+	k_work_reschedule(&due_work, K_TIMEOUT_ABS_MS(MAX(when_ms, k_uptime_get())));
+}
+
+static void due_fn(struct k_work *work)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	due_cmd = sched_cmd;
+	due_pending = true;
+	k_spin_unlock(&lock, key);
+
+	if (due_cb) {
+		due_cb();
+	}
+}
+
+bool group_sync_take(led_cmd_t *cmd)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	bool pending = due_pending;
+
+	*cmd = due_cmd;
+	due_pending = false;
+	k_spin_unlock(&lock, key);
+
+	return pending;
+}
+
+/* Called with tx_lock held */
+static int set_per_adv_data(void)
+{
+	struct bt_data ad = BT_DATA(BT_DATA_MANUFACTURER_DATA, &tx_msg, sizeof(tx_msg));
+
+	tx_msg.now_ms = sys_cpu_to_le32(k_uptime_get_32());
+	return bt_le_per_adv_set_data(adv, &ad, 1);
+}
+
+static void timebase_fn(struct k_work *work)
+{
+	// never between the fields of a command being published
+	k_mutex_lock(&tx_lock, K_FOREVER);
+	set_per_adv_data();
+	k_mutex_unlock(&tx_lock);
+	// twice per interval, so some stamps land just before an event
+	k_work_schedule(&timebase_work, K_MSEC(CONFIG_SAMPLE_GROUP_SYNC_INTERVAL_MS / 2));
+}
+
+static int broadcaster_start(void)
+{
+	int err;
+
+	err = bt_le_ext_adv_create(BT_LE_EXT_ADV_NCONN, NULL, &adv);
+	if (err) {
+		return err;
+	}
+
+	err = bt_le_ext_adv_set_data(adv, ext_ad, ARRAY_SIZE(ext_ad), NULL, 0);
+	if (err) {
+		return err;
+	}
+
+	err = bt_le_per_adv_set_param(adv, BT_LE_PER_ADV_PARAM(
+		PER_ADV_UNITS(CONFIG_SAMPLE_GROUP_SYNC_INTERVAL_MS),
+		PER_ADV_UNITS(CONFIG_SAMPLE_GROUP_SYNC_INTERVAL_MS),
+		BT_LE_PER_ADV_OPT_NONE));
+	if (err) {
+		return err;
+	}
+
+	err = set_per_adv_data();
+	if (err) {
+		return err;
+	}
+
+	err = bt_le_per_adv_start(adv);
+	if (err) {
+		return err;
+	}
+
+	err = bt_le_ext_adv_start(adv, BT_LE_EXT_ADV_START_DEFAULT);
+	if (err) {
+		return err;
+	}
+
+	k_work_schedule(&timebase_work, K_MSEC(CONFIG_SAMPLE_GROUP_SYNC_INTERVAL_MS / 2));
+	LOG_INF("Broadcasting group %u", CONFIG_SAMPLE_GROUP_ID);
+	return 0;
+}
+
+/* Put a new command on the train; called with tx_lock held */
+static int tx_command(const led_cmd_t *cmd, uint32_t apply_ms)
+{
+	struct group_msg prev = tx_msg;
+	int err;
+
+	if (adv == NULL) {
+		// a phone picked this unit, so it leads the group from now on
+		if (sync) {
+			bt_le_per_adv_sync_delete(sync);
+			sync = NULL;
+		}
+		scan_mgr_release(SCAN_USER_GROUP);
+
+		tx_msg.company = sys_cpu_to_le16(COMPANY_ID_TEST);
+		tx_msg.version = MSG_VERSION;
+		tx_msg.group = CONFIG_SAMPLE_GROUP_ID;
+
+		err = broadcaster_start();
+		if (err) {
+			LOG_WRN("Group broadcast failed (%d)", err);
+			return err;
+		}
+		prev = tx_msg;
+	}
+
+	// receivers key on seq, so it must never go out with another command
+	tx_msg.apply_ms = sys_cpu_to_le32(apply_ms);
+	tx_msg.led = *cmd;
+	tx_msg.seq++;
+
+	err = set_per_adv_data();
+	if (err) {
+		tx_msg = prev;
+	}
+	return err;
+}
+
+int group_sync_publish(const led_cmd_t *cmd)
+{
+	uint32_t apply_ms = k_uptime_get_32() + CONFIG_SAMPLE_GROUP_SYNC_LEAD_MS;
+	int err;
+
+	k_mutex_lock(&tx_lock, K_FOREVER);
+	err = tx_command(cmd, apply_ms);
+	k_mutex_unlock(&tx_lock);
+	if (err) {
+		return err;
+	}
+
+	schedule(cmd, apply_ms);
+	return 0;
+}
+
+static void offset_sample(uint32_t remote_ms)
+{
+	int64_t sample = (int64_t)remote_ms - k_uptime_get();
+
+	window_max = window_len ? MAX(window_max, sample) : sample;
+	if (++window_len < CONFIG_SAMPLE_GROUP_SYNC_WINDOW) {
+		if (!offset_valid) {
+			offset_ms = window_max; // best guess until the first window closes
+		}
+		return;
+	}
+
+	if (offset_valid && window_max != offset_ms) {
+		LOG_DBG("Timebase moved %lld ms", window_max - offset_ms);
+	}
+	offset_ms = window_max;
+	offset_valid = true;
+	window_len = 0;
+}
+
+static void sync_recv(struct bt_le_per_adv_sync *s,
+		      const struct bt_le_per_adv_sync_recv_info *info,
+		      struct net_buf_simple *buf)
+{
+	const struct group_msg *msg;
+	uint8_t len;
+
+	msg = (const struct group_msg *)ad_find(buf, BT_DATA_MANUFACTURER_DATA, &len);
+	if (msg == NULL || len < sizeof(*msg) ||
+	    sys_le16_to_cpu(msg->company) != COMPANY_ID_TEST ||
+	    msg->version != MSG_VERSION || msg->group != CONFIG_SAMPLE_GROUP_ID) {
+		return;
+	}
+
+	offset_sample(sys_le32_to_cpu(msg->now_ms));
+
+	if (rx_seq_valid && msg->seq == rx_seq) {
+		return; // repeat of a command already scheduled
+	}
+	rx_seq = msg->seq;
+
+	// the first report after syncing only sets the timebase
+	if (rx_seq_valid) {
+		schedule(&msg->led, (int64_t)sys_le32_to_cpu(msg->apply_ms) - offset_ms);
+	}
+	rx_seq_valid = true;
+}
+
+static void synced(struct bt_le_per_adv_sync *s, struct bt_le_per_adv_sync_synced_info *info)
+{
+	LOG_INF("Synced to group broadcaster, interval %u ms", info->interval * 5 / 4);
+	rx_seq_valid = false;
+	window_len = 0;
+	offset_valid = false;
+	// central.c may keep scanning for its siblings, that is its own request
+	scan_mgr_release(SCAN_USER_GROUP);
+}
+
+static void term(struct bt_le_per_adv_sync *s,
+		 const struct bt_le_per_adv_sync_term_info *info)
+{
+	LOG_INF("Group sync lost (reason %u)", info->reason);
+	sync = NULL;
+	if (adv == NULL) {
+		group_sync_start();
+	}
+}
+
+static struct bt_le_per_adv_sync_cb sync_callbacks = {
+	.synced = synced,
+	.term = term,
+	.recv = sync_recv,
+};
+
+static void scan_recv(const struct bt_le_scan_recv_info *info, struct net_buf_simple *ad)
+{
+	struct bt_le_per_adv_sync_param param = {
+		.sid = info->sid,
+		.skip = 0,
+		.timeout = SYNC_TIMEOUT_UNITS(CONFIG_SAMPLE_GROUP_SYNC_INTERVAL_MS * 10),
+	};
+	int err;
+
+	if (sync || adv || info->interval == 0 || !ad_has_uuid128(ad, control_uuid)) {
+		return;
+	}
+
+	bt_addr_le_copy(&param.addr, info->addr);
+	err = bt_le_per_adv_sync_create(&param, &sync);
+	if (err) {
+		LOG_WRN("Group sync create failed (%d)", err);
+		sync = NULL;
+	}
+}
+
+static struct bt_le_scan_cb scan_callbacks = {
+	.recv = scan_recv,
+};
+
+void group_sync_init(group_sync_cb_t cb)
+{
+	due_cb = cb;
+	bt_le_scan_cb_register(&scan_callbacks);
+	bt_le_per_adv_sync_cb_register(&sync_callbacks);
+}
+
+int group_sync_start(void)
+{
+	struct bt_le_scan_param param = {
+		.type = BT_LE_SCAN_TYPE_PASSIVE,
+		.options = BT_LE_SCAN_OPT_NONE,
+		.interval = BT_GAP_SCAN_FAST_INTERVAL,
+		.window = BT_GAP_SCAN_FAST_WINDOW,
+	};
+
+	// shares the scanner with central.c, see src/scan_mgr.c
+	return scan_mgr_request(SCAN_USER_GROUP, &param);
+}
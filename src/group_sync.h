@@ -0,0 +1,35 @@
+#ifndef GROUP_SYNC_H
+#define GROUP_SYNC_H
+
+#include <stdbool.h>
+#include "led_strip_src/led_strip.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Called from the system work queue when a group command is due */
+typedef void (*group_sync_cb_t)(void);
+
+/** @brief Register the due callback; call before bt_enable() */
+void group_sync_init(group_sync_cb_t cb);
+
+/** @brief Start listening for a group broadcaster; after bt_enable() */
+int group_sync_start(void);
+
+/**
+ * @brief Broadcast a command to the group and schedule it here as well.
+ *
+ * Returns 0 when the command was scheduled; the caller applies it when the
+ * due callback fires instead of right away.
+ */
+int group_sync_publish(const led_cmd_t *cmd);
+
+/** @brief Take the command that came due. Returns false if there is none. */
+bool group_sync_take(led_cmd_t *cmd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GROUP_SYNC_H
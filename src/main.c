@@ -14,120 +14,80 @@
 #include <zephyr/bluetooth/uuid.h>
 #include "led_strip_src/led_strip.h"
 #include "motor_src/motor.h"
+#include "button_src/button.h"
 #include <zephyr/logging/log.h>
 #include <zephyr/input/input.h>
+#include <zephyr/settings/settings.h>
 #include "ble_uuids.h"
+#include "cmd_queue.h"
+#include "telemetry.h"
+#include "conn_policy.h"
+#include "central.h"
+#include "group_sync.h"
+#include "app_settings.h"
+#include "app_fsm.h"
+#include "diag.h"
+#include "dfu.h"
+#include "power.h"
 
 #define LOG_LEVEL_INF   3
 #define LED1_NODE DT_ALIAS(led0)
 #define LED2_NODE DT_ALIAS(led1)
-#define BUTTON0_NODE DT_ALIAS(brightness_incr)
-#define BUTTON1_NODE DT_ALIAS(brightness_decr)
 
 LOG_MODULE_REGISTER(ble_fsm_demo, LOG_LEVEL_INF);
 
-extern led_cmd_t led_cmd_data;  // the struct filled in write_cb
-
 // led pins
 static const struct gpio_dt_spec led1 = GPIO_DT_SPEC_GET(LED1_NODE, gpios);
 static const struct gpio_dt_spec led2 = GPIO_DT_SPEC_GET(LED2_NODE, gpios);
 
-// button pins
-static const struct gpio_dt_spec brightness_incr = GPIO_DT_SPEC_GET(BUTTON0_NODE, gpios); // button 0: brightness up
-static const struct gpio_dt_spec brightness_decr = GPIO_DT_SPEC_GET(BUTTON1_NODE, gpios); // button 1: brightness down
-
 // global variables
 int sensor_flag = 0; // flag to detect when motor is on
-static int sensor_led_mode = 0; // mode state flag
-static int last_vibration_count = 0;
-
-// Global brightness control (0-255)
-static int global_brightness = 255; // Default brightness
-
-// flags for command received
-volatile bool ble_command_received = false;
-volatile bool motor_command_received = false;
-volatile bool motor_config_received = false;
-
-/* FSM States */
-typedef enum {
-	STATE_IDLE,
-	STATE_PERIPHERAL,
-	STATE_LED_CTRL,
-	STATE_MOTOR_CONFIG,
-} ble_state_t;
-
-static ble_state_t current_state = STATE_IDLE;
-static struct bt_conn *current_conn = NULL;
 
 // Characteristic names for UI/tools debug
 #define CONTROL_SERVICE_NAME     "SLB Control Service"
 #define LED_CTRL_NAME            "LED Control"
 #define MOTOR_CTRL_NAME          "Motor Control"
 #define MOTOR_CFG_NAME           "Motor Config"
+#define PIXEL_STREAM_NAME        "Pixel Stream"
+#define TELEMETRY_NAME           "Telemetry"
 
-
-/* Callback on read from phone*/
-static ssize_t read_cb(struct bt_conn *conn,
-		       const struct bt_gatt_attr *attr,
-		       void *buf, uint16_t len,
-		       uint16_t offset)
+/* Callback on write from phone */
+static ssize_t write_cb(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
 {
-	const char *value = "LED On"; // read result: 4C 45 44 20 4F 6E
-	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, strlen(value));
+	ssize_t ret = app_cmd_write(bt_conn_index(conn), POINTER_TO_UINT(attr->user_data),
+				    buf, len, offset);
+
+	if (ret >= 0) {
+		conn_policy_activity(conn);
+	}
+	return ret;
 }
 
-/* Callback on write from phone */
-ssize_t write_cb(struct bt_conn *conn, const struct bt_gatt_attr *attr,
-                 const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+/* Callback on pixel stream write, kept off the logging path above */
+static ssize_t stream_write_cb(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			       const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
 {
-	// data declare
-    const uint8_t *data = (const uint8_t *)buf;
-
-	// Convert to string for UTF-8 command detection
-    char str_buf[64] = {0};
-    uint16_t str_len = len < sizeof(str_buf) - 1 ? len : sizeof(str_buf) - 1;
-    memcpy(str_buf, data, str_len); 
-    str_buf[str_len] = '\0';
-	
-	printk("\nReceived command:");
-    for (int i = 0; i < len; i++) {
-        printk(" %02X", ((const uint8_t *)buf)[i]);
-    }
-    printk("\n");
-
-	// compare UUID LED
-	if (bt_uuid_cmp(attr->uuid, &led_char_uuid.uuid) == 0) {
-		if (len == sizeof(led_cmd_t)) {
-			ble_command_received = true;
-			const led_cmd_t *cmd = (const led_cmd_t *)buf;
-			memcpy(&led_cmd_data, cmd, sizeof(led_cmd_t));
-			printk(">> Switching to STATE_LED_CTRL (brightness: %d) <<\n", global_brightness);
-			current_state = STATE_LED_CTRL;
-		} 
-	} else if (bt_uuid_cmp(attr->uuid, &motor_char_uuid.uuid) == 0) {
-		motor_command_received = true;
-	} else if (bt_uuid_cmp(attr->uuid, &motor_config_char_uuid.uuid) == 0) {
-		printk(">> Switching to STATE_MOTOR_CONFIG <<\n");
-		motor_config_received = true;
-		current_state = STATE_MOTOR_CONFIG;
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
 	}
 
-	// print string & debug
-	// printk("String: '%s'\n", str_buf);
-	// printk("len = %d\n", len);
-	// printk("sizeof(led_cmd_t) = %d\n", sizeof(led_cmd_t));
-	// printk("First byte: 0x%02X\n", ((const uint8_t *)buf)[0]);
+	if (led_stream_write(buf, len)) {
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
 
-    // return len;
+	conn_policy_activity(conn);
+	return len;
 }
+
 /*
 custom_svc: is the service UUID
 control_service_uuid: UUID of the characteristic
 BT_GATT_CHRC_WRITE: allows writing
 BT_GATT_PERM_WRITE: permission for writing
 write_cb: function to handle the write
-read_cb : function to handle the read
+telemetry_read: every read returns the cached telemetry snapshot
+user_data: enum app_cmd_type queued by write_cb
 */
 
 /* Custom GATT services */
@@ -135,44 +95,60 @@ BT_GATT_SERVICE_DEFINE(custom_svc,
 	BT_GATT_PRIMARY_SERVICE(&control_service_uuid),
 
 	BT_GATT_CHARACTERISTIC(&led_char_uuid.uuid,
-	BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY,
+	BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
 	BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-	read_cb, write_cb, NULL),
+	telemetry_read, write_cb, UINT_TO_POINTER(APP_CMD_LED)),
 	BT_GATT_CUD(LED_CTRL_NAME, BT_GATT_PERM_READ),
 
 	BT_GATT_CHARACTERISTIC(&motor_char_uuid.uuid,
-	BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY,
+	BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
 	BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-	read_cb, write_cb, NULL),
+	telemetry_read, write_cb, UINT_TO_POINTER(APP_CMD_MOTOR)),
 	BT_GATT_CUD(MOTOR_CTRL_NAME, BT_GATT_PERM_READ),
 
 	BT_GATT_CHARACTERISTIC(&motor_config_char_uuid.uuid,
-	BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY,
+	BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
 	BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-	read_cb, write_cb, NULL),
+	telemetry_read, write_cb, UINT_TO_POINTER(APP_CMD_MOTOR_CFG)),
 	BT_GATT_CUD(MOTOR_CFG_NAME, BT_GATT_PERM_READ),
+
+	BT_GATT_CHARACTERISTIC(&pixel_stream_char_uuid.uuid,
+	BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+	BT_GATT_PERM_WRITE,
+	NULL, stream_write_cb, NULL),
+	BT_GATT_CUD(PIXEL_STREAM_NAME, BT_GATT_PERM_READ),
+
+	BT_GATT_CHARACTERISTIC(&telemetry_char_uuid.uuid,
+	BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+	BT_GATT_PERM_READ,
+	telemetry_read, NULL, NULL),
+	BT_GATT_CCC(telemetry_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CUD(TELEMETRY_NAME, BT_GATT_PERM_READ),
 );
 
 /* Peripheral Callbacks */
+/* Only phones count; sibling links, either direction, are central.c's */
 static void connected(struct bt_conn *conn, uint8_t err)
 {
-	if (!err) {
-		current_conn = conn;
-		current_state = STATE_IDLE;
-		printk("Phone is connected\n");
-		gpio_pin_set_dt(&led1, 1);	
+	if (!err && central_is_phone(conn)) {
+		unsigned int n = app_fsm_phone(true);
+
+		printk("Phone %u connected (%u/%d)\n", bt_conn_index(conn), n,
+		       CONFIG_BT_MAX_CONN);
 	}
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
-	current_conn = NULL;
-	printk("Phone disconnected\n");
-	gpio_pin_set_dt(&led1, 0);
-	if (current_state == STATE_IDLE) {
-		bt_disable();
-		current_state = STATE_IDLE;
+	if (!central_is_phone(conn)) {
+		return;
 	}
+
+	unsigned int n = app_fsm_phone(false);
+
+	printk("Phone %u disconnected (%u/%d)\n", bt_conn_index(conn), n,
+	       CONFIG_BT_MAX_CONN);
+	// advertising restarts by itself, see src/adv_mgr.c
 }
 
 BT_CONN_CB_DEFINE(conn_callbacks) = {
@@ -180,194 +156,142 @@ BT_CONN_CB_DEFINE(conn_callbacks) = {
 	.disconnected = disconnected,
 };
 
-/* Central: Scan callback */
-static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
-			struct net_buf_simple *ad)
+#if defined(CONFIG_SAMPLE_GROUP_SYNC)
+/* Runs on the system work queue when a group command is due */
+static void group_cmd_due(void)
 {
-	char addr_str[BT_ADDR_LE_STR_LEN], name[32] = {0};
-	bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
-	printk("Found device %s, RSSI: %d dBm\n", addr_str, rssi);
-	
-	// Extract name from advertising payload
-    for (int i = 0; i < ad->len - 1;) {
-        uint8_t len = ad->data[i++];
-        if (len == 0 || (i + len - 1) > ad->len) break;
-        uint8_t type = ad->data[i++];
-        if (type == BT_DATA_NAME_COMPLETE || type == BT_DATA_NAME_SHORTENED) {
-            memcpy(name, &ad->data[i], MIN(len - 1, sizeof(name) - 1));
-            printk("Device name: %s\n", name);
-            break;
-        }
-        i += len - 2;
-    }
-
-	// TODO: match UUID/name then connect (preserved)
-	gpio_pin_set_dt(&led2, 1);
-	current_state = STATE_IDLE;
-	bt_le_scan_stop();
+	app_fsm_post(FSM_EVT_GROUP);
 }
+#endif
 
-void start_scan(void)
+#if defined(CONFIG_SAMPLE_CENTRAL)
+/* Sibling link indicator on the second LED */
+static void sibling_links(unsigned int links)
 {
-	struct bt_le_scan_param scan_param = {
-		.type       = BT_LE_SCAN_PASSIVE,
-		.options    = BT_LE_SCAN_OPT_NONE,
-		.interval   = 0x0010,
-		.window     = 0x0010,
-	};
-
-	int err = bt_le_scan_start(&scan_param, device_found);
-    if (err) {
-        printk("Scan failed (err %d)\n", err);
-    } else {
-        printk("Scanning started...\n");
-    }
+	gpio_pin_set_dt(&led2, links > 0);
 }
+#endif
 
-const char *motor_status(void)
-	{
-		motor_on();
-    	return "ON";
-	}
+static void button_steps_pending(void)
+{
+	app_fsm_post(FSM_EVT_BUTTON);
+}
+
+static void power_idle(void)
+{
+	app_fsm_post(FSM_EVT_IDLE);
+}
 
-// button brightness handle
-void button_handler(void){
-	static bool last_incr_state = false;
-	static bool last_decr_state = false;
-	static bool config_initialized = false;
-
-	// Initialize config state only once
-	if (!config_initialized) {
-		printk(">> STATE_MOTOR_CONFIG : ON <<\n");
-		printk("Global brightness control: 0-255 (10 units per press)\n");
-		printk("Current brightness: %d\n", global_brightness);
-		config_initialized = true;
+/* Frame events from the LED work queues: histograms and the wake report */
+static void strip_event(enum led_strip_event evt, uint32_t start)
+{
+	switch (evt) {
+	case LED_STRIP_FRAME_PUSHED:
+		diag_count(DIAG_C_FRAMES_PUSHED);
+		break;
+	case LED_STRIP_FRAME_SENT:
+		diag_since(DIAG_H_STRIP_TX, start);
+		diag_count(DIAG_C_FRAMES_SENT);
+		power_frame_sent(); // wake-to-first-frame after deep idle
+		break;
+	case LED_STRIP_FIRST_PIXELS:
+		diag_since(DIAG_H_APPLY_PIXELS, start);
+		break;
 	}
+}
 
-	// Check buttons once per loop iteration (non-blocking)
-	bool incr_pressed = gpio_pin_get_dt(&brightness_incr) == 0;
-	bool decr_pressed = gpio_pin_get_dt(&brightness_decr) == 0;
+/* Phone connected LED */
+static void status_led(bool on)
+{
+	gpio_pin_set_dt(&led1, on);
+}
 
-	// Get the last command to preserve color settings
-	const led_cmd_t* last_cmd = get_last_led_cmd();
+/* Bluetooth came up; runs on the system work queue */
+static void bt_ready(int err)
+{
+	if (err) {
+		printk("Bluetooth init failed\n");
+		return;
+	}
 
-	// Only print when button state changes from not pressed to pressed
-	if (incr_pressed && !last_incr_state) {
-		global_brightness += 10;
-		if (global_brightness > 100) {
-			global_brightness = 100;
-		}
-		printk(">> Global Brightness ++: %d\n", global_brightness);
+	printk("Bluetooth enabled\n");
+	// this image got as far as Bluetooth, keep it if it came from an update
+	dfu_confirm();
+	// bonds, for directed advertising; the app subtree is loaded before bt_enable()
+	settings_load_subtree("bt");
+	LOG_INF("Bluetooth ready at %u ms", k_uptime_get_32());
+	LOG_INF("App RAM per connection: %u B (queue %u, link policy %u, telemetry %u)",
+		cmd_queue_peer_ram() + conn_policy_peer_ram() + telemetry_peer_ram(),
+		cmd_queue_peer_ram(), conn_policy_peer_ram(), telemetry_peer_ram());
+	app_fsm_post(FSM_EVT_ADVERTISE);
+#if defined(CONFIG_SAMPLE_CENTRAL)
+	central_start();
+#endif
+#if defined(CONFIG_SAMPLE_GROUP_SYNC)
+	group_sync_start();
+#endif
+}
 
-		led_cmd_t brightness_cmd = *last_cmd;  // Copy last command
-		brightness_cmd.brightness = global_brightness; // Sync it
-		led_strip_control(&brightness_cmd); // Use latest brightness
+void main(void)
+{
+	led_cmd_t saved[LED_ZONES];
+	uint32_t restored;
 
+	if (!gpio_is_ready_dt(&led1) || !gpio_is_ready_dt(&led2)) {
+		printk("Status LEDs not ready\n");
 	}
+	gpio_pin_configure_dt(&led1, GPIO_OUTPUT_INACTIVE);
+	gpio_pin_configure_dt(&led2, GPIO_OUTPUT_INACTIVE);
 
-	if (decr_pressed && !last_decr_state) {
-		global_brightness -= 10;
-		if (global_brightness < 0) {
-			global_brightness = 0;
-		}
-		printk(">> Global Brightness --: %d\n", global_brightness);
+	int strip_err = led_strip_init();
 
-		led_cmd_t brightness_cmd = *last_cmd;  // Copy last command
-		brightness_cmd.brightness = global_brightness; // Sync it
-		led_strip_control(&brightness_cmd); // Use latest brightness
-	}
+	led_strip_set_event_cb(strip_event);
 
-	// Update last states
-	last_incr_state = incr_pressed;
-	last_decr_state = decr_pressed;
+	app_fsm_init(status_led);
 
-	// Small delay to prevent too rapid changes
-	if (incr_pressed || decr_pressed) {
-		k_msleep(50); // debounce
+	// paint the last state before anything slow happens
+	restored = strip_err == 0 ? app_settings_load(saved) : 0;
+	for (uint8_t z = 0; z < LED_ZONES; z++) {
+		if (restored & BIT(z)) {
+			LOG_INF("Restored LED zone %u mode %u at %u%%", z, saved[z].mode,
+				saved[z].brightness);
+			led_strip_control_zone(z, &saved[z]);
+		}
 	}
+	telemetry_init(bt_gatt_find_by_uuid(custom_svc.attrs, custom_svc.attr_count,
+					    &telemetry_char_uuid.uuid));
 
-	// safety check
-	if (last_cmd == NULL) {
-		printk("No previous command available\n");
-		return;
-	}
-}
+#if defined(CONFIG_SAMPLE_CENTRAL)
+	// second LED shows whether a sibling unit is linked
+	central_init(sibling_links);
+#endif
 
-void main(void)
-{    
-	gpio_pin_configure_dt(&led1, GPIO_OUTPUT_INACTIVE);
-	gpio_pin_configure_dt(&led2, GPIO_OUTPUT_INACTIVE);
+#if defined(CONFIG_SAMPLE_GROUP_SYNC)
+	group_sync_init(group_cmd_due);
+#endif
 
-	// button pins
-	gpio_pin_configure_dt(&brightness_incr, GPIO_INPUT);
-	gpio_pin_configure_dt(&brightness_decr, GPIO_INPUT);
-	gpio_pin_set_dt(&brightness_incr, 1);
-	gpio_pin_set_dt(&brightness_decr, 1);
+	// button events come from the gpio-keys input driver
+	button_init(button_steps_pending);
 
-	// delay
-	k_sleep(K_MSEC(150));
+	// deep idle once the strip is dark and nobody is connected
+	power_init(power_idle);
 
-	if (bt_enable(NULL) == 0) {
-		printk("Bluetooth enabled\n");
-		k_sleep(K_MSEC(150));
-		current_state = STATE_PERIPHERAL;
-	} else {
+	// vibration sensor reports taps by interrupt from here on
+	if (motor_init(app_fsm_taps)) {
+		printk("Vibration sensor init failed\n");
+	}
+#if defined(CONFIG_SAMPLE_TAP_EMUL)
+	motor_emul_start();
+#endif
+#if defined(CONFIG_SAMPLE_CMD_EMUL)
+	app_cmd_emul_start();
+#endif
+
+	// bt_ready() starts advertising once the controller is up, the FSM runs meanwhile
+	if (bt_enable(bt_ready)) {
 		printk("Bluetooth init failed\n");
 		return;
 	}
 
-	// turn on sensor & detect flag
-	while (1) {
-		// FSM for BLE and sensor/LED logic
-		switch (current_state) {
-			case STATE_PERIPHERAL:
-				printk("Acting as Peripheral...\n");
-				bt_le_adv_start(BT_LE_ADV_CONN_NAME, NULL, 0, NULL, 0);
-				current_state = STATE_IDLE;
-				break;
-			case STATE_IDLE:
-				// Handle motor command if received
-				if (motor_command_received) {
-					printk(">> Motor control triggered <<\n");
-					LOG_INF("Motor state: %s", motor_status());
-					motor_command_received = false;
-				}
-				
-				// Tap detection and LED mode cycling
-				if (vibration_count != last_vibration_count) {
-					motor_command_received = true;
-					last_vibration_count = vibration_count;
-					sensor_led_mode = (sensor_led_mode + 1) % 3;
-					printk("Tap detected! New mode: %d\n", sensor_led_mode);
-					led_cmd_t sensor_cmd = {
-						.mode = sensor_led_mode,
-						.r = 255, .g = 0, .b = 0, // Only used in mode 0
-						.brightness = global_brightness, // Uses global brightness
-						.duration = 0
-					};
-					k_sleep(K_MSEC(100));
-					led_strip_control(&sensor_cmd);
-				}
-				k_sleep(K_MSEC(10));
-				break;
-			case STATE_LED_CTRL:
-				// Handle BLE LED command
-				led_strip_control(&led_cmd_data);
-				current_state = STATE_IDLE; // Always return to IDLE
-				break;
-			case STATE_MOTOR_CONFIG:				
-				// Check if motor config flag is enabled before executing
-				if (motor_config_received) {
-
-					button_handler();
-
-				} else {
-					// Exit motor config state when flag is cleared
-					printk("Motor configuration: done\n");
-					motor_config_received = false;
-					current_state = STATE_IDLE;
-				}
-				break;
-		}
-	}	
+	app_fsm_run();
 }
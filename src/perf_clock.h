@@ -0,0 +1,48 @@
+#ifndef PERF_CLOCK_H
+#define PERF_CLOCK_H
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Clock for timing code that does not sleep. On the simulated boards
+ * (native_sim, nrf52_bsim) code runs in zero simulated time, so
+ * k_cycle_get_32() differences read 0; there this reads the host's
+ * monotonic clock in ns instead. Only differences of up to a few seconds
+ * mean anything. Time spent sleeping is simulated, so measure that with
+ * the kernel clocks.
+ */
+#if defined(CONFIG_NATIVE_LIBRARY)
+/** @brief Host monotonic clock in ns, see perf_clock_host.c */
+uint32_t perf_clock_host_ns(void);
+
+static inline uint32_t perf_clock_get(void)
+{
+	return perf_clock_host_ns();
+}
+
+static inline uint64_t perf_clock_to_ns(uint64_t t)
+{
+	return t;
+}
+#else
+static inline uint32_t perf_clock_get(void)
+{
+	return k_cycle_get_32();
+}
+
+static inline uint64_t perf_clock_to_ns(uint64_t t)
+{
+	return k_cyc_to_ns_floor64(t);
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PERF_CLOCK_H
@@ -0,0 +1,15 @@
+/*
+ * Host side of src/perf_clock.h. Built into the native simulator runner
+ * against the host C library, so it can read the host's clock.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+uint32_t perf_clock_host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec);
+}
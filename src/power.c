@@ -0,0 +1,159 @@
+/*
+ * Deep idle while the strip is dark and no phone is connected.
+ *
+ * The FSM enters its deep idle state once the strip has been dark and
+ * nothing connected for CONFIG_SAMPLE_POWER_IDLE_DELAY_MS. Entry releases
+ * the strip's output bus and the console UART through device runtime PM,
+ * after the deferred log has drained and its backends are stopped. The
+ * drivers then power the peripherals down and the HF clock is no longer
+ * requested, so the idle thread sleeps in System ON with only the RTC and
+ * the radio's advertising events running. System OFF would end
+ * advertising, so a phone could not wake the unit.
+ *
+ * Any FSM event leaves the state: a tap (the sensor line interrupt), a
+ * button, a command or a connection. Exit takes the devices back before
+ * the event is handled, and the time from there to the first frame on the
+ * strip is logged. The idle current logged on entry is an estimate from
+ * CONFIG_SAMPLE_ADV_SLEEP_UA and CONFIG_SAMPLE_ADV_EVENT_CHARGE_NC, not a
+ * measurement; the strip's own supply is not included.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/logging/log_ctrl.h>
+#include <zephyr/logging/log_backend.h>
+LOG_MODULE_REGISTER(power, LOG_LEVEL_INF);
+
+#include "power.h"
+#include "adv_mgr.h"
+#include "led_strip_src/led_strip.h"
+
+#define LOG_DRAIN_MS   100   // longest wait for the deferred log to empty
+#define WAKE_WINDOW_MS 1000  // a first frame later than this is not the wake's
+
+#if DT_HAS_CHOSEN(zephyr_console)
+static const struct device *const console = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+#endif
+
+static power_idle_cb_t idle_cb;
+
+/* Owned by the FSM thread */
+static uint32_t backends_off;  // bit per log backend stopped by power_suspend()
+static int64_t idle_since;
+
+static atomic_t wake_stamp;    // cycle count of the wake, 0 once reported
+
+static void idle_fn(struct k_work *work)
+{
+	idle_cb();
+}
+
+static K_WORK_DELAYABLE_DEFINE(idle_work, idle_fn);
+
+/* Floor plus advertising, see CONFIG_SAMPLE_ADV_EVENT_CHARGE_NC */
+static uint32_t idle_ua(void)
+{
+	uint32_t event_us = adv_mgr_event_us();
+
+	return CONFIG_SAMPLE_ADV_SLEEP_UA +
+	       (event_us ? CONFIG_SAMPLE_ADV_EVENT_CHARGE_NC * 1000U / event_us : 0);
+}
+
+static void console_power(bool on)
+{
+#if DT_HAS_CHOSEN(zephyr_console)
+	int rc = on ? pm_device_runtime_get(console) : pm_device_runtime_put(console);
+
+	if (rc) {
+		LOG_WRN("Console %s: %d", on ? "resume" : "suspend", rc);
+	}
+#endif
+}
+
+void power_init(power_idle_cb_t cb)
+{
+	idle_cb = cb;
+	// the console stays taken while awake, like the strip's bus
+#if DT_HAS_CHOSEN(zephyr_console)
+	(void)pm_device_runtime_enable(console);
+#endif
+	console_power(true);
+	led_strip_set_idle_cb(power_arm);
+}
+
+void power_arm(void)
+{
+	k_work_reschedule(&idle_work, K_MSEC(CONFIG_SAMPLE_POWER_IDLE_DELAY_MS));
+}
+
+void power_suspend(void)
+{
+	int64_t deadline = k_uptime_get() + LOG_DRAIN_MS;
+	int rc;
+
+	rc = led_strip_power(false);
+	if (rc) {
+		LOG_WRN("Strip bus suspend: %d", rc);
+	}
+	LOG_INF("Deep idle, ~%u uA estimated (advertising every %u ms)", idle_ua(),
+		adv_mgr_event_us() / 1000);
+
+	// the log thread writes to the console, let it finish first
+	while (log_data_pending() && k_uptime_get() < deadline) {
+		k_sleep(K_MSEC(1));
+	}
+	for (int i = 0; i < log_backend_count_get(); i++) {
+		const struct log_backend *backend = log_backend_get(i);
+
+		if (log_backend_is_active(backend)) {
+			log_backend_disable(backend);
+			backends_off |= BIT(i);
+		}
+	}
+	console_power(false);
+
+	atomic_clear(&wake_stamp);
+	idle_since = k_uptime_get();
+}
+
+void power_resume(const char *why)
+{
+	int rc;
+
+	// stamped first, the frame may be out before this returns
+	atomic_set(&wake_stamp, k_cycle_get_32() | 1);
+
+	console_power(true);
+	for (int i = 0; i < log_backend_count_get(); i++) {
+		const struct log_backend *backend = log_backend_get(i);
+
+		if (backends_off & BIT(i)) {
+			log_backend_enable(backend, backend->cb->ctx, CONFIG_LOG_MAX_LEVEL);
+		}
+	}
+	backends_off = 0;
+
+	rc = led_strip_power(true);
+	if (rc) {
+		LOG_ERR("Strip bus resume: %d", rc);
+	}
+	LOG_INF("Woken by %s after %lld ms", why, k_uptime_get() - idle_since);
+}
+
+/* Runs on the led_tx work queue */
+void power_frame_sent(void)
+{
+	uint32_t stamp = atomic_clear(&wake_stamp);
+	uint32_t us;
+
+	if (stamp == 0) {
+		return;
+	}
+	us = k_cyc_to_us_floor32(k_cycle_get_32() - stamp);
+	if (us < WAKE_WINDOW_MS * USEC_PER_MSEC) {
+		LOG_INF("Wake to first frame: %u us", us);
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef POWER_H
+#define POWER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Called from the system work queue once dark and disconnected long enough */
+typedef void (*power_idle_cb_t)(void);
+
+#if defined(CONFIG_SAMPLE_POWER)
+/**
+ * @brief Register the idle callback and take the console. Call from main
+ * after the strip is up; the strip's idle callback is hooked here too.
+ */
+void power_init(power_idle_cb_t cb);
+
+/**
+ * @brief (Re)start the CONFIG_SAMPLE_POWER_IDLE_DELAY_MS countdown to the
+ * idle callback. Safe from any thread.
+ */
+void power_arm(void);
+
+/** @brief Release the strip's bus and the console, stop the log backends */
+void power_suspend(void);
+
+/** @brief Undo power_suspend(); @p why names the wake source for the log */
+void power_resume(const char *why);
+
+/** @brief A frame reached the strip; reports the first one after a wake */
+void power_frame_sent(void);
+#else
+static inline void power_init(power_idle_cb_t cb) {}
+static inline void power_arm(void) {}
+static inline void power_suspend(void) {}
+static inline void power_resume(const char *why) {}
+static inline void power_frame_sent(void) {}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // POWER_H
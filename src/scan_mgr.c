@@ -0,0 +1,131 @@
+/*
+ * Scan manager: one owner for the scanner shared by central.c and
+ * group_sync.c.
+ *
+ * Each module states what it wants through scan_mgr_request() and takes it
+ * back with scan_mgr_release(); neither starts or stops the scanner
+ * itself, so one cannot end the other's scan. The requests are merged into
+ * one set of parameters and the scanner is restarted only when that set
+ * changes. Holds switch it off for as long as the controller needs it
+ * idle, e.g. while a connection is being created.
+ *
+ * Callers are the BT RX thread and the system work queue; the mutex
+ * serializes them around the HCI calls.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(scan_mgr, LOG_LEVEL_INF);
+
+#include "scan_mgr.h"
+
+static K_MUTEX_DEFINE(scan_mutex);
+static struct bt_le_scan_param requests[SCAN_USERS];
+static uint32_t wanted;           // bit per user with a request
+static unsigned int holds;
+static bool running;
+static struct bt_le_scan_param active;
+
+/* The widest request wins; the accept list only if everyone filters */
+static void merge(struct bt_le_scan_param *out)
+{
+	const struct bt_le_scan_param *best = NULL;
+	bool filter = true;
+
+	for (int i = 0; i < SCAN_USERS; i++) {
+		const struct bt_le_scan_param *r = &requests[i];
+
+		if (!(wanted & BIT(i))) {
+			continue;
+		}
+		filter &= (r->options & BT_LE_SCAN_OPT_FILTER_ACCEPT_LIST) != 0;
+		// window/interval compared without dividing
+		if (best == NULL ||
+		    (uint32_t)r->window * best->interval > (uint32_t)best->window * r->interval ||
+		    ((uint32_t)r->window * best->interval == (uint32_t)best->window * r->interval &&
+		     r->interval < best->interval)) {
+			best = r;
+		}
+	}
+
+	*out = *best;
+	out->options &= ~BT_LE_SCAN_OPT_FILTER_ACCEPT_LIST;
+	if (filter) {
+		out->options |= BT_LE_SCAN_OPT_FILTER_ACCEPT_LIST;
+	}
+}
+
+/* Bring the scanner in line with the requests; called with scan_mutex held */
+static int apply(void)
+{
+	struct bt_le_scan_param param;
+	int err;
+
+	if (holds || !wanted) {
+		if (running) {
+			err = bt_le_scan_stop();
+			if (err) {
+				LOG_WRN("Scan stop failed (%d)", err);
+				return err;
+			}
+			running = false;
+		}
+		return 0;
+	}
+
+	merge(&param);
+	if (running) {
+		if (param.type == active.type && param.options == active.options &&
+		    param.interval == active.interval && param.window == active.window) {
+			return 0;
+		}
+		err = bt_le_scan_stop();
+		if (err) {
+			LOG_WRN("Scan stop failed (%d)", err);
+			return err;
+		}
+		running = false;
+	}
+
+	err = bt_le_scan_start(&param, NULL);
+	if (err) {
+		LOG_WRN("Scan failed (%d)", err);
+		return err;
+	}
+	active = param;
+	running = true;
+	return 0;
+}
+
+int scan_mgr_request(enum scan_user user, const struct bt_le_scan_param *param)
+{
+	int err;
+
+	k_mutex_lock(&scan_mutex, K_FOREVER);
+	requests[user] = *param;
+	wanted |= BIT(user);
+	err = apply();
+	k_mutex_unlock(&scan_mutex);
+	return err;
+}
+
+void scan_mgr_release(enum scan_user user)
+{
+	k_mutex_lock(&scan_mutex, K_FOREVER);
+	wanted &= ~BIT(user);
+	(void)apply();
+	k_mutex_unlock(&scan_mutex);
+}
+
+void scan_mgr_hold(bool on)
+{
+	k_mutex_lock(&scan_mutex, K_FOREVER);
+	if (on) {
+		holds++;
+	} else if (holds) {
+		holds--;
+	}
+	(void)apply();
+	k_mutex_unlock(&scan_mutex);
+}
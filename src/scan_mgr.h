@@ -0,0 +1,40 @@
+#ifndef SCAN_MGR_H
+#define SCAN_MGR_H
+
+#include <stdbool.h>
+#include <zephyr/bluetooth/bluetooth.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Modules sharing the scanner, one request each */
+enum scan_user {
+	SCAN_USER_CENTRAL,  // sibling discovery, src/central.c
+	SCAN_USER_GROUP,    // group broadcaster discovery, src/group_sync.c
+	SCAN_USERS,
+};
+
+/**
+ * @brief Ask for scanning on behalf of @p user, replacing its previous
+ * request. The scanner runs with the highest duty cycle asked for, and
+ * filters on the accept list only if every request does. Reports go to
+ * every registered bt_le_scan_cb, whoever started the scan.
+ */
+int scan_mgr_request(enum scan_user user, const struct bt_le_scan_param *param);
+
+/** @brief Drop @p user's request; the scanner stops when none is left */
+void scan_mgr_release(enum scan_user user);
+
+/**
+ * @brief Keep the scanner off while held (@p on true), for connection
+ * creation and accept list changes. Holds nest; requests made meanwhile
+ * take effect on the last release.
+ */
+void scan_mgr_hold(bool on);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCAN_MGR_H
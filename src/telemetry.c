@@ -0,0 +1,346 @@
+/*
+ * Batched, rate-limited telemetry notifications.
+ *
+ * Events are appended as small [type][len][value] records to a buffer per
+ * subscribed phone. Each link flushes on its own timer, at most once per
+ * CONFIG_SAMPLE_TELEMETRY_INTERVAL_MS, and packs as many whole records as
+ * fit in that link's MTU into one notification sent on that link only. A
+ * slow or small-MTU phone therefore neither holds back nor shrinks the
+ * notifications of the others. Records that do not fit wait for the next
+ * flush; when a buffer is full new records are dropped and counted.
+ *
+ * Link parameters are kept per connection too: each phone gets the `05`
+ * records and the snapshot field of its own link.
+ *
+ * Reads return the cached snapshot, which is kept current as events come
+ * in, so nothing is formatted on demand.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(telemetry, LOG_LEVEL_INF);
+
+#include "telemetry.h"
+#include "central.h"
+
+#define REC_HDR_LEN 2
+#define FLUSH_INTERVAL K_MSEC(CONFIG_SAMPLE_TELEMETRY_INTERVAL_MS)
+
+/* One subscribed phone; everything but flush_work under lock */
+struct peer {
+	struct bt_conn *conn;   // our reference while subscribed
+	struct k_work_delayable flush_work;
+	uint8_t buf[CONFIG_SAMPLE_TELEMETRY_BUF_SIZE];
+	size_t len;
+	uint32_t dropped;
+	uint32_t gen;  // bumped whenever buf is emptied without being sent
+	struct conn_policy_info link;  // little endian, any link, subscribed or not
+};
+
+static const struct bt_gatt_attr *notify_attr;
+static atomic_t subscribers;  // bit per connection index
+
+static struct k_spinlock lock;
+static struct peer peers[CONFIG_BT_MAX_CONN];
+
+static struct telemetry_snapshot snapshot = {
+	.version = TELEMETRY_VERSION,
+};
+
+/* Length of the longest run of whole records that fits in room */
+static size_t records_fitting(const struct peer *p, size_t room)
+{
+	size_t len = 0;
+
+	while (len < p->len) {
+		size_t rec = REC_HDR_LEN + p->buf[len + 1];
+
+		if (len + rec > room) {
+			break;
+		}
+		len += rec;
+	}
+
+	return len;
+}
+
+static void flush_fn(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct peer *p = CONTAINER_OF(dwork, struct peer, flush_work);
+	static uint8_t pkt[CONFIG_SAMPLE_TELEMETRY_BUF_SIZE];
+	struct bt_conn *conn;
+	k_spinlock_key_t key;
+	uint32_t dropped;
+	uint32_t gen;
+	size_t room;
+	size_t len;
+	int err;
+
+	// a reference of our own, the phone may leave while we notify
+	key = k_spin_lock(&lock);
+	conn = p->conn ? bt_conn_ref(p->conn) : NULL;
+	k_spin_unlock(&lock, key);
+	if (conn == NULL) {
+		return;
+	}
+	room = MIN(bt_gatt_get_mtu(conn) - 3, sizeof(pkt));
+
+	key = k_spin_lock(&lock);
+	len = records_fitting(p, room);
+	memcpy(pkt, p->buf, len);
+	dropped = p->dropped;
+	p->dropped = 0;
+	gen = p->gen;
+	k_spin_unlock(&lock, key);
+
+	if (dropped) {
+		LOG_WRN("%u telemetry records dropped for phone %u", dropped,
+			bt_conn_index(conn));
+	}
+
+	err = len ? bt_gatt_notify(conn, notify_attr, pkt, len) : 0;
+	bt_conn_unref(conn);
+	if (err) {
+		// keep the records, the next flush retries
+		k_work_schedule(dwork, FLUSH_INTERVAL);
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+	// emptied meanwhile: what is there now was never sent
+	if (gen == p->gen) {
+		p->len -= len;
+		memmove(p->buf, &p->buf[len], p->len);
+	}
+	len = p->len;
+	k_spin_unlock(&lock, key);
+
+	// rate limit: whatever is left goes out one interval later
+	if (len) {
+		k_work_schedule(dwork, FLUSH_INTERVAL);
+	}
+}
+
+/* Queue one record for a peer; called with lock held */
+static void peer_append(struct peer *p, uint8_t type, const void *value, uint8_t len)
+{
+	if (p->len + REC_HDR_LEN + len > sizeof(p->buf)) {
+		p->dropped++;
+		return;
+	}
+
+	p->buf[p->len++] = type;
+	p->buf[p->len++] = len;
+	memcpy(&p->buf[p->len], value, len);
+	p->len += len;
+
+	// no-op if a flush is already pending, which is what batches records
+	k_work_schedule(&p->flush_work, FLUSH_INTERVAL);
+}
+
+/* Update the snapshot field at dst and queue the event for subscribers */
+static void record(uint8_t type, void *dst, const void *value, uint8_t len)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	atomic_val_t mask = atomic_get(&subscribers);
+
+	if (dst != NULL) {
+		memcpy(dst, value, len);
+	}
+	snapshot.uptime_ms = sys_cpu_to_le32(k_uptime_get_32());
+
+	for (size_t i = 0; mask; i++, mask >>= 1) {
+		if (mask & 1) {
+			peer_append(&peers[i], type, value, len);
+		}
+	}
+	k_spin_unlock(&lock, key);
+}
+
+void telemetry_init(const struct bt_gatt_attr *attr)
+{
+	notify_attr = attr;
+}
+
+void telemetry_state(uint8_t state)
+{
+	if (state == snapshot.state) {
+		return;
+	}
+	record(TELEMETRY_REC_STATE, &snapshot.state, &state, sizeof(state));
+}
+
+void telemetry_led_cmd(const led_cmd_t *cmd)
+{
+	if (memcmp(cmd, &snapshot.led, sizeof(*cmd)) == 0) {
+		return;
+	}
+	record(TELEMETRY_REC_LED_CMD, &snapshot.led, cmd, sizeof(*cmd));
+}
+
+void telemetry_tap(uint32_t seq, uint32_t timestamp)
+{
+	uint32_t value[2] = { sys_cpu_to_le32(seq), sys_cpu_to_le32(timestamp) };
+
+	record(TELEMETRY_REC_TAP, NULL, value, sizeof(value));
+}
+
+void telemetry_counters(const struct telemetry_counters *counters)
+{
+	struct telemetry_counters le = {
+		.cmds = sys_cpu_to_le32(counters->cmds),
+		.cmds_dropped = sys_cpu_to_le32(counters->cmds_dropped),
+		.taps = sys_cpu_to_le32(counters->taps),
+		.taps_dropped = sys_cpu_to_le32(counters->taps_dropped),
+	};
+
+	// counters only matter when they change, so skip identical ones
+	if (memcmp(&le, &snapshot.counters, sizeof(le)) == 0) {
+		return;
+	}
+
+	record(TELEMETRY_REC_COUNTERS, &snapshot.counters, &le, sizeof(le));
+}
+
+void telemetry_conn(struct bt_conn *conn, const struct conn_policy_info *info)
+{
+	uint8_t idx = bt_conn_index(conn);
+	struct peer *p = &peers[idx];
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (memcmp(info, &p->link, sizeof(*info)) != 0) {
+		p->link = *info;
+		// only the link it describes hears about it
+		if (atomic_test_bit(&subscribers, idx)) {
+			peer_append(p, TELEMETRY_REC_CONN, info, sizeof(*info));
+		}
+	}
+	k_spin_unlock(&lock, key);
+}
+
+ssize_t telemetry_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+		       void *buf, uint16_t len, uint16_t offset)
+{
+	struct telemetry_snapshot snap;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	snap = snapshot;
+	snap.conn = peers[bt_conn_index(conn)].link;  // the reader's own link
+	k_spin_unlock(&lock, key);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &snap, sizeof(snap));
+}
+
+/* Subscribed phones, each with a reference the caller drops or keeps */
+static void subscribed_cb(struct bt_conn *conn, void *data)
+{
+	struct bt_conn **found = data;
+
+	if (central_is_phone(conn) &&
+	    bt_gatt_is_subscribed(conn, notify_attr, BT_GATT_CCC_NOTIFY)) {
+		found[bt_conn_index(conn)] = bt_conn_ref(conn);
+	}
+}
+
+/* Called with lock held; returns the reference to drop once unlocked */
+static struct bt_conn *peer_drop(struct peer *p)
+{
+	struct bt_conn *conn = p->conn;
+
+	p->conn = NULL;
+	p->len = 0;
+	p->dropped = 0;
+	p->gen++;
+	k_work_cancel_delayable(&p->flush_work);
+	return conn;
+}
+
+void telemetry_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	struct bt_conn *found[ARRAY_SIZE(peers)] = { NULL };
+	struct bt_conn *gone[ARRAY_SIZE(peers)] = { NULL };
+	atomic_val_t mask = 0;
+	atomic_val_t old;
+	k_spinlock_key_t key;
+
+	// the CCC value is the OR of all peers, so ask each connection
+	bt_conn_foreach(BT_CONN_TYPE_LE, subscribed_cb, found);
+
+	key = k_spin_lock(&lock);
+	for (size_t i = 0; i < ARRAY_SIZE(peers); i++) {
+		struct peer *p = &peers[i];
+
+		if (found[i] == NULL) {
+			gone[i] = peer_drop(p);
+			continue;
+		}
+		mask |= BIT(i);
+		if (p->conn) {
+			gone[i] = found[i];  // already subscribed, keeps its own
+			continue;
+		}
+
+		// start a new subscriber off with the full current state
+		p->conn = found[i];
+		peer_append(p, TELEMETRY_REC_STATE, &snapshot.state, sizeof(snapshot.state));
+		peer_append(p, TELEMETRY_REC_LED_CMD, &snapshot.led, sizeof(snapshot.led));
+		peer_append(p, TELEMETRY_REC_COUNTERS, &snapshot.counters,
+			    sizeof(snapshot.counters));
+		peer_append(p, TELEMETRY_REC_CONN, &p->link, sizeof(p->link));
+	}
+	old = atomic_set(&subscribers, mask);
+	k_spin_unlock(&lock, key);
+
+	for (size_t i = 0; i < ARRAY_SIZE(gone); i++) {
+		if (gone[i]) {
+			bt_conn_unref(gone[i]);
+		}
+	}
+
+	if (mask != old) {
+		LOG_INF("Telemetry subscribers: 0x%02lx", mask);
+	}
+}
+
+size_t telemetry_peer_ram(void)
+{
+	return sizeof(peers[0]);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	uint8_t idx = bt_conn_index(conn);
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	struct bt_conn *gone;
+
+	atomic_clear_bit(&subscribers, idx);
+	gone = peer_drop(&peers[idx]);
+	memset(&peers[idx].link, 0, sizeof(peers[idx].link));
+	k_spin_unlock(&lock, key);
+
+	if (gone) {
+		bt_conn_unref(gone);
+	}
+}
+
+BT_CONN_CB_DEFINE(telemetry_conn_callbacks) = {
+	.disconnected = disconnected,
+};
+
+static int telemetry_sys_init(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(peers); i++) {
+		k_work_init_delayable(&peers[i].flush_work, flush_fn);
+	}
+	return 0;
+}
+
+SYS_INIT(telemetry_sys_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,73 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <zephyr/bluetooth/gatt.h>
+#include "led_strip_src/led_strip.h"
+#include "conn_policy.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Record types packed into telemetry notifications as [type][len][value] */
+enum telemetry_rec {
+	TELEMETRY_REC_STATE = 1,     // uint8_t FSM state
+	TELEMETRY_REC_LED_CMD = 2,   // led_cmd_t
+	TELEMETRY_REC_TAP = 3,       // uint32_t seq, uint32_t timestamp (cycles)
+	TELEMETRY_REC_COUNTERS = 4,  // struct telemetry_counters
+	TELEMETRY_REC_CONN = 5,      // struct conn_policy_info
+};
+
+/** Running totals, little endian on air */
+struct telemetry_counters {
+	uint32_t cmds;          // commands queued by write_cb
+	uint32_t cmds_dropped;  // commands lost to a full queue
+	uint32_t taps;
+	uint32_t taps_dropped;
+} __packed;
+
+/** Binary snapshot returned by reads, rebuilt as events arrive */
+struct telemetry_snapshot {
+	uint8_t version;
+	uint8_t state;
+	led_cmd_t led;
+	struct telemetry_counters counters;
+	struct conn_policy_info conn;  // the reading link's own
+	uint32_t uptime_ms;     // when the snapshot last changed
+} __packed;
+
+#define TELEMETRY_VERSION 2
+
+/** @brief Bind to the notifying characteristic value attribute */
+void telemetry_init(const struct bt_gatt_attr *attr);
+
+/** @brief Record events; called from the FSM thread, unchanged values are skipped */
+void telemetry_state(uint8_t state);
+void telemetry_led_cmd(const led_cmd_t *cmd);
+void telemetry_counters(const struct telemetry_counters *counters);
+
+/** @brief Record one tap; called from the sensor thread */
+void telemetry_tap(uint32_t seq, uint32_t timestamp);
+
+/**
+ * @brief Record the parameters of @p conn (little endian); only that link
+ * is notified. May be called from any thread.
+ */
+void telemetry_conn(struct bt_conn *conn, const struct conn_policy_info *info);
+
+/** @brief GATT read handler returning the cached snapshot */
+ssize_t telemetry_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+		       void *buf, uint16_t len, uint16_t offset);
+
+/** @brief CCC changed handler for the telemetry characteristic */
+void telemetry_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value);
+
+/** @brief Telemetry RAM set aside per connection */
+size_t telemetry_peer_ram(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TELEMETRY_H
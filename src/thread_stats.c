@@ -0,0 +1,114 @@
+/*
+ * Per-thread stack high-water marks and CPU share.
+ *
+ * Every CONFIG_SAMPLE_THREAD_STATS_INTERVAL seconds each thread is logged
+ * with its priority, the most stack it has used so far and its share of
+ * the cycles spent since the previous report. Idle shows what is left.
+ * scripts/thread_report.py collects these lines from a native_sim run.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(thread_stats, LOG_LEVEL_INF);
+
+#define MAX_THREADS CONFIG_SAMPLE_THREAD_STATS_MAX
+
+struct thread_sample {
+	const struct k_thread *thread;
+	uint64_t cycles;  // execution cycles at the previous report
+};
+
+struct thread_row {
+	const struct k_thread *thread;
+	int prio;
+	size_t size;
+	size_t used;
+	uint64_t cycles;
+};
+
+static struct thread_sample prev[MAX_THREADS];
+static uint64_t prev_total;
+
+static struct thread_row rows[MAX_THREADS];
+static size_t nrows;
+static size_t skipped;
+
+static uint64_t prev_cycles(const struct k_thread *thread)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(prev); i++) {
+		if (prev[i].thread == thread) {
+			return prev[i].cycles;
+		}
+	}
+	return 0;
+}
+
+/* Runs with the thread list locked, so it only copies numbers */
+static void collect(const struct k_thread *thread, void *user_data)
+{
+	struct thread_row *r;
+	k_thread_runtime_stats_t rt;
+	size_t unused = 0;
+
+	if (nrows == ARRAY_SIZE(rows)) {
+		skipped++;
+		return;
+	}
+
+	r = &rows[nrows++];
+	r->thread = thread;
+	r->prio = k_thread_priority_get((k_tid_t)thread);
+	r->size = thread->stack_info.size;
+	k_thread_stack_space_get(thread, &unused);
+	r->used = r->size - unused;
+	k_thread_runtime_stats_get((k_tid_t)thread, &rt);
+	r->cycles = rt.execution_cycles;
+}
+
+static void thread_stats_report(struct k_work *work)
+{
+	k_thread_runtime_stats_t all;
+	uint64_t total;
+
+	nrows = 0;
+	skipped = 0;
+	k_thread_foreach(collect, NULL);
+	k_thread_runtime_stats_all_get(&all);
+	total = all.execution_cycles - prev_total;
+	prev_total = all.execution_cycles;
+
+	for (size_t i = 0; i < nrows; i++) {
+		const struct thread_row *r = &rows[i];
+		const char *name = k_thread_name_get((k_tid_t)r->thread);
+		uint64_t busy = r->cycles - prev_cycles(r->thread);
+		// per mille, so the log needs no float support
+		uint32_t share = total ? (uint32_t)(busy * 1000 / total) : 0;
+
+		LOG_INF("thread %-12s prio %3d stack %5zu/%5zu cpu %3u.%u%%",
+			name ? name : "?", r->prio, r->used, r->size,
+			share / 10, share % 10);
+	}
+	if (skipped) {
+		LOG_WRN("%zu threads not shown, raise CONFIG_SAMPLE_THREAD_STATS_MAX",
+			skipped);
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(prev); i++) {
+		prev[i].thread = i < nrows ? rows[i].thread : NULL;
+		prev[i].cycles = i < nrows ? rows[i].cycles : 0;
+	}
+
+	k_work_schedule(k_work_delayable_from_work(work),
+			K_SECONDS(CONFIG_SAMPLE_THREAD_STATS_INTERVAL));
+}
+
+static K_WORK_DELAYABLE_DEFINE(report_work, thread_stats_report);
+
+static int thread_stats_init(void)
+{
+	k_work_schedule(&report_work, K_SECONDS(CONFIG_SAMPLE_THREAD_STATS_INTERVAL));
+	return 0;
+}
+
+SYS_INIT(thread_stats_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
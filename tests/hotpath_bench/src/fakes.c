@@ -0,0 +1,64 @@
+/*
+ * Stand-ins for the modules the FSM calls that need the Bluetooth stack
+ * or the sensor hardware. Calls the tests look at are recorded in fakes.
+ */
+
+#include <zephyr/kernel.h>
+
+#include "src/adv_mgr.h"
+#include "src/app_settings.h"
+#include "src/conn_policy.h"
+#include "src/telemetry.h"
+#include "motor_src/motor.h"
+#include "button_src/button.h"
+#include "fakes.h"
+
+struct fakes fakes;
+
+void adv_mgr_start(void)
+{
+	fakes.adv_starts++;
+}
+
+int button_take_steps(void)
+{
+	int steps = fakes.button_steps;
+
+	fakes.button_steps = 0;
+	return steps;
+}
+
+bool motor_is_armed(void)
+{
+	return false;
+}
+
+uint32_t motor_tap_dropped(void)
+{
+	return 0;
+}
+
+void telemetry_state(uint8_t state)
+{
+	fakes.state = state;
+}
+
+void telemetry_led_cmd(const led_cmd_t *cmd)
+{
+}
+
+void telemetry_counters(const struct telemetry_counters *counters)
+{
+}
+
+void telemetry_tap(uint32_t seq, uint32_t timestamp)
+{
+}
+
+void conn_policy_cmd_latency(uint32_t us)
+{
+}
+
+void app_settings_save_led(uint8_t zone, const led_cmd_t *led)
+{
+}
@@ -0,0 +1,23 @@
+#ifndef FAKES_H
+#define FAKES_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* What the FSM did through the faked modules, see fakes.c */
+struct fakes {
+	uint32_t adv_starts;  // adv_mgr_start() calls
+	int button_steps;     // handed out by the next button_take_steps()
+	uint8_t state;        // last telemetry_state()
+};
+
+extern struct fakes fakes;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKES_H
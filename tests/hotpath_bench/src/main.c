@@ -0,0 +1,366 @@
+/*
+ * The paths every command goes through: checked, then timed.
+ *
+ * Each path is checked for the right result first, then timed over
+ * BENCH_ITERATIONS runs with the perf clock (src/perf_clock.h), which is
+ * the host clock on native_sim since code runs in zero simulated time
+ * there. Times are printed as "bench: <name> ... ns/op"; a zero total
+ * fails the test, as it means nothing was measured.
+ *
+ * The FSM runs without Bluetooth: src/fakes.c stands in for the modules
+ * that need the stack or the sensor, and events are posted directly.
+ */
+
+#include <string.h>
+
+#include <zephyr/ztest.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#include "src/app_fsm.h"
+#include "src/cmd_queue.h"
+#include "src/ad_parse.h"
+#include "src/ble_uuids.h"
+#include "src/perf_clock.h"
+#include "led_strip_src/led_strip.h"
+#include "led_strip_src/led_internal.h"
+#include "fakes.h"
+
+#define BENCH_ITERATIONS 1000
+#define DARK_TIMEOUT_MS  1000  // longest fade to dark before deep idle
+
+static const led_cmd_t red = { .mode = LED_MODE_RGB, .r = 255, .brightness = 30 };
+static const led_cmd_t blue = { .mode = LED_MODE_RGB, .b = 255, .brightness = 60 };
+
+static bool status_led_on;
+
+static void status_led(bool on)
+{
+	status_led_on = on;
+}
+
+static void report(const char *name, uint64_t t)
+{
+	uint64_t ns = perf_clock_to_ns(t);
+
+	printk("bench: %s %llu ns/op\n", name, ns / BENCH_ITERATIONS);
+	zassert_true(ns > 0, "%s timed at zero, no clock behind the perf clock", name);
+}
+
+/* A control write from connection slot @p peer */
+static ssize_t write_from(uint8_t peer, enum app_cmd_type type, const void *buf,
+			  uint16_t len)
+{
+	return app_cmd_write(peer, type, buf, len, 0);
+}
+
+static ssize_t led_write(const led_cmd_t *cmd)
+{
+	return write_from(0, APP_CMD_LED, cmd, sizeof(*cmd));
+}
+
+/* Post @p events and run the FSM as the main loop would, until no handler posts one */
+static ble_state_t fsm_run(uint32_t events)
+{
+	app_fsm_post(events);
+	while (app_fsm_poll()) {
+		// deep idle wakes by re-posting the event that woke it
+	}
+	return app_fsm_state();
+}
+
+static bool zone0_is(const led_cmd_t *cmd)
+{
+	led_cmd_t whole;
+
+	return led_strip_zone_get(0, &whole) && memcmp(&whole, cmd, sizeof(whole)) == 0;
+}
+
+static void *hotpath_setup(void)
+{
+	zassert_ok(led_strip_init());
+	return NULL;
+}
+
+/* Every test starts in STATE_IDLE with nothing queued or posted */
+static void hotpath_before(void *fixture)
+{
+	struct app_cmd left;
+
+	while (cmd_queue_get(&left, 1) > 0) {
+	}
+	while (app_fsm_poll()) {
+	}
+	app_fsm_init(status_led);
+	status_led_on = false;
+	memset(&fakes, 0, sizeof(fakes));
+}
+
+ZTEST_SUITE(hotpath, NULL, hotpath_setup, hotpath_before, NULL, NULL);
+
+ZTEST(hotpath, test_cmd_write)
+{
+	const uint8_t zoned[sizeof(led_cmd_t) + 1] = { LED_MODE_RGB, 0, 255, 0, 50, 0,
+						       APP_LED_ZONES - 1 };
+	uint8_t bad_zone[sizeof(zoned)];
+	struct app_cmd out[CMD_QUEUE_PEERS];
+	uint64_t t = 0;
+	uint32_t start;
+
+	zassert_equal(led_write(&red), sizeof(red));
+	zassert_equal(cmd_queue_get(out, 1), 1);
+	zassert_equal(out[0].type, APP_CMD_LED);
+	zassert_equal(out[0].zone, 0);
+	zassert_mem_equal(&out[0].led, &red, sizeof(red));
+
+	// a 7th byte picks the zone
+	zassert_equal(write_from(1, APP_CMD_LED, zoned, sizeof(zoned)), sizeof(zoned));
+	zassert_equal(cmd_queue_get(out, 1), 1);
+	zassert_equal(out[0].peer, 1);
+	zassert_equal(out[0].zone, APP_LED_ZONES - 1);
+
+	memcpy(bad_zone, zoned, sizeof(zoned));
+	bad_zone[sizeof(led_cmd_t)] = APP_LED_ZONES;
+	zassert_equal(write_from(0, APP_CMD_LED, bad_zone, sizeof(bad_zone)),
+		      BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED));
+	zassert_equal(write_from(0, APP_CMD_LED, &red, sizeof(red) - 1),
+		      BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN));
+	zassert_equal(app_cmd_write(0, APP_CMD_LED, &red, sizeof(red), 1),
+		      BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET));
+	zassert_equal(cmd_queue_get(out, 1), 0, "rejected writes were queued");
+
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		start = perf_clock_get();
+		led_write(&red);
+		t += perf_clock_get() - start;
+		cmd_queue_get(out, ARRAY_SIZE(out));
+	}
+	report("app_cmd_write", t);
+}
+
+ZTEST(hotpath, test_ad_parser)
+{
+	// flags, complete name, then the service UUID: the usual sibling layout
+	static const uint8_t match[] = {
+		0x02, BT_DATA_FLAGS, BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR,
+		0x05, BT_DATA_NAME_COMPLETE, 'l', 'a', 'm', 'p',
+		0x11, BT_DATA_UUID128_ALL, BT_UUID_CONTROL_SERVICE_VAL,
+	};
+	static const uint8_t other[] = {
+		0x02, BT_DATA_FLAGS, BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR,
+		0x11, BT_DATA_UUID128_ALL, BT_UUID_LED_CONTROL_CHAR_VAL,
+	};
+	static const uint8_t truncated[] = {
+		0x11, BT_DATA_UUID128_ALL, 0x00, 0x10,
+	};
+	static const uint8_t uuid[] = { BT_UUID_CONTROL_SERVICE_VAL };
+	struct net_buf_simple ad;
+	volatile bool hit; // keeps the calls
+	uint32_t start, t;
+
+	net_buf_simple_init_with_data(&ad, (void *)match, sizeof(match));
+	zassert_true(ad_has_uuid128(&ad, uuid));
+	net_buf_simple_init_with_data(&ad, (void *)other, sizeof(other));
+	zassert_false(ad_has_uuid128(&ad, uuid));
+	net_buf_simple_init_with_data(&ad, (void *)truncated, sizeof(truncated));
+	zassert_false(ad_has_uuid128(&ad, uuid));
+
+	net_buf_simple_init_with_data(&ad, (void *)match, sizeof(match));
+	start = perf_clock_get();
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		hit = ad_has_uuid128(&ad, uuid);
+	}
+	t = perf_clock_get() - start;
+	(void)hit;
+	report("ad_has_uuid128", t);
+}
+
+ZTEST(hotpath, test_brightness_scale)
+{
+	zassert_equal(led_brightness_scale(0), 0);
+	zassert_equal(led_brightness_scale(50), 128);
+	zassert_equal(led_brightness_scale(LED_BRIGHTNESS_MAX), 256, "100% is 1.0 in 8.8");
+	zassert_equal(led_brightness_scale(UINT8_MAX), 256, "out of range not clamped");
+
+	for (uint8_t b = 1; b <= LED_BRIGHTNESS_MAX; b++) {
+		zassert_true(led_brightness_scale(b) > led_brightness_scale(b - 1),
+			     "scale not increasing at %u%%", b);
+	}
+}
+
+ZTEST(hotpath, test_color_dim)
+{
+	const struct led_rgb c = { .r = 255, .g = 128, .b = 1 };
+	struct led_rgb out;
+
+	out = led_color_dim(c, led_brightness_scale(LED_BRIGHTNESS_MAX));
+	zassert_true(out.r == 255 && out.g == 128 && out.b == 1, "full scale changed the color");
+
+	out = led_color_dim(c, led_brightness_scale(0));
+	zassert_true(out.r == 0 && out.g == 0 && out.b == 0, "zero scale is not black");
+
+	out = led_color_dim(c, led_brightness_scale(50));
+	zassert_true(out.r == 127 && out.g == 64 && out.b == 0,
+		     "half scale gave %u/%u/%u", out.r, out.g, out.b);
+}
+
+ZTEST(hotpath, test_color_gamma)
+{
+	const struct led_rgb black = { 0 };
+	const struct led_rgb white = { .r = 255, .g = 255, .b = 255 };
+	struct led_rgb out, prev = black;
+
+	out = led_color_gamma(black);
+	zassert_true(out.r == 0 && out.g == 0 && out.b == 0, "black is lit");
+
+	// full scale is capped at the configured output level
+	out = led_color_gamma(white);
+	zassert_true(out.r == CONFIG_SAMPLE_LED_BRIGHTNESS && out.g == out.r && out.b == out.r,
+		     "white gave %u/%u/%u", out.r, out.g, out.b);
+
+	for (int i = 1; i <= UINT8_MAX; i++) {
+		out = led_color_gamma((struct led_rgb){ .r = i, .g = i, .b = i });
+		zassert_true(out.g == out.r && out.b == out.r, "channels differ at %d", i);
+		zassert_true(out.r >= prev.r, "gamma not monotonic at %d", i);
+		prev = out;
+	}
+
+	// mid grey comes out darker than linear once gamma is above 1.0
+	out = led_color_gamma((struct led_rgb){ .r = 128 });
+	if (CONFIG_SAMPLE_LED_GAMMA_X10 > 10) {
+		zassert_true(out.r < 128 * CONFIG_SAMPLE_LED_BRIGHTNESS / 255,
+			     "mid grey gave %u", out.r);
+	}
+}
+
+ZTEST(hotpath, test_led_strip_control)
+{
+	led_cmd_t cmd = { .mode = LED_MODE_RELAX, .brightness = 40, .duration = 0 };
+	uint32_t start, t;
+
+	zassert_ok(led_strip_control(&cmd));
+	zassert_mem_equal(get_last_led_cmd(), &cmd, sizeof(cmd));
+
+	start = perf_clock_get();
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		cmd.brightness = i % (LED_BRIGHTNESS_MAX + 1);
+		led_strip_control(&cmd);
+	}
+	t = perf_clock_get() - start;
+	report("led_strip_control", t);
+}
+
+ZTEST(hotpath, test_fsm_led_cmd)
+{
+	uint64_t t = 0;
+	uint32_t start;
+
+	// an LED write is applied without leaving the state
+	led_write(&red);
+	zassert_equal(fsm_run(FSM_EVT_CMD), STATE_IDLE);
+	zassert_true(zone0_is(&red));
+
+	// two writes in one batch: the later one wins
+	led_write(&red);
+	led_write(&blue);
+	zassert_equal(fsm_run(FSM_EVT_CMD), STATE_IDLE);
+	zassert_true(zone0_is(&blue));
+
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		led_write((i & 1) ? &red : &blue);
+		start = perf_clock_get();
+		fsm_run(FSM_EVT_CMD);
+		t += perf_clock_get() - start;
+	}
+	report("fsm LED command", t);
+}
+
+/* LED writes taken before another command are applied before it */
+ZTEST(hotpath, test_fsm_cmd_order)
+{
+	const uint8_t cfg = 1;
+	led_cmd_t whole;
+
+	fsm_run(FSM_EVT_ADVERTISE);
+	app_fsm_phone(true);
+	zassert_equal(fsm_run(FSM_EVT_CONNECTED), STATE_LED_CTRL);
+
+	// the LED write would end motor config, but it came first
+	led_write(&red);
+	write_from(0, APP_CMD_MOTOR_CFG, &cfg, sizeof(cfg));
+	zassert_equal(fsm_run(FSM_EVT_CMD), STATE_MOTOR_CONFIG);
+	zassert_true(zone0_is(&red));
+
+	// buttons step the brightness in motor config only
+	fakes.button_steps = -1;
+	zassert_equal(fsm_run(FSM_EVT_BUTTON), STATE_MOTOR_CONFIG);
+	zassert_true(led_strip_zone_get(0, &whole));
+	zassert_equal(whole.brightness, red.brightness - 10);
+	zassert_equal(fakes.button_steps, 0);
+
+	write_from(0, APP_CMD_MOTOR_CFG, &cfg, sizeof(cfg));
+	led_write(&blue);
+	zassert_equal(fsm_run(FSM_EVT_CMD), STATE_LED_CTRL);
+	zassert_true(zone0_is(&blue));
+
+	fakes.button_steps = 1;
+	zassert_equal(fsm_run(FSM_EVT_BUTTON), STATE_LED_CTRL);
+	zassert_true(zone0_is(&blue), "button applied outside motor config");
+	zassert_equal(fakes.button_steps, 0, "steps left for later");
+
+	app_fsm_phone(false);
+	zassert_equal(fsm_run(FSM_EVT_DISCONNECTED), STATE_PERIPHERAL);
+}
+
+/* Up, connected and back, then into deep idle and out again */
+ZTEST(hotpath, test_fsm_transitions)
+{
+	const led_cmd_t off = { .mode = LED_MODE_RGB, .brightness = 0, .duration = 0 };
+	int64_t deadline;
+
+	// advertising starts on every way into PERIPHERAL
+	zassert_equal(fsm_run(FSM_EVT_ADVERTISE), STATE_PERIPHERAL);
+	zassert_equal(fakes.adv_starts, 1);
+	zassert_equal(fakes.state, STATE_PERIPHERAL, "state not published");
+
+	zassert_equal(app_fsm_phone(true), 1);
+	zassert_equal(fsm_run(FSM_EVT_CONNECTED), STATE_LED_CTRL);
+	zassert_true(status_led_on);
+	zassert_equal(app_fsm_phone(true), 2);
+	zassert_equal(fsm_run(FSM_EVT_CONNECTED), STATE_LED_CTRL);
+	zassert_equal(fsm_run(FSM_EVT_IDLE), STATE_LED_CTRL);
+
+	// the first phone leaving is not the last
+	zassert_equal(app_fsm_phone(false), 1);
+	zassert_equal(fsm_run(FSM_EVT_DISCONNECTED), STATE_LED_CTRL);
+	zassert_equal(app_fsm_phone(false), 0);
+	zassert_equal(fsm_run(FSM_EVT_DISCONNECTED), STATE_PERIPHERAL);
+	zassert_false(status_led_on);
+	zassert_equal(fakes.adv_starts, 2);
+
+	// a lit strip keeps it out of deep idle
+	led_write(&red);
+	fsm_run(FSM_EVT_CMD);
+	zassert_false(led_strip_dark());
+	zassert_equal(fsm_run(FSM_EVT_IDLE), STATE_PERIPHERAL);
+
+	led_write(&off);
+	zassert_equal(fsm_run(FSM_EVT_CMD), STATE_PERIPHERAL);
+	deadline = k_uptime_get() + DARK_TIMEOUT_MS;
+	while (!led_strip_dark() && k_uptime_get() < deadline) {
+		k_sleep(K_MSEC(1));
+	}
+	zassert_true(led_strip_dark());
+	zassert_equal(fsm_run(FSM_EVT_IDLE), STATE_DEEP_IDLE);
+	zassert_equal(fsm_run(FSM_EVT_IDLE), STATE_DEEP_IDLE);
+
+	// a wake is handled as the event that caused it
+	zassert_equal(app_fsm_phone(true), 1);
+	zassert_equal(fsm_run(FSM_EVT_CONNECTED), STATE_LED_CTRL);
+	zassert_equal(app_fsm_phone(false), 0);
+	zassert_equal(fsm_run(FSM_EVT_DISCONNECTED), STATE_PERIPHERAL);
+	zassert_equal(fsm_run(FSM_EVT_IDLE), STATE_DEEP_IDLE);
+	led_write(&blue);
+	zassert_equal(fsm_run(FSM_EVT_CMD), STATE_PERIPHERAL);
+	zassert_true(zone0_is(&blue), "waking write not applied");
+}
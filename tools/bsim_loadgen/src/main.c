@@ -0,0 +1,268 @@
+/*
+ * BabbleSim load generator: a simulated phone hammering custom_svc.
+ *
+ * Output lines, all times in us of simulated uptime:
+ *   lg: tx <seq> <led|motor|cfg> t <us>
+ *   lg: rsp <seq> err <att err> t <us>
+ *   lg: done sent <n> ok <n> err <n> backpressure <n>
+ *   lg: dfu start bytes <n> t <us>
+ *   lg: dfu done bytes <n> rc <rc> t <us>
+ *
+ * LED writes use mode 0 with the sequence number in r/g/b, so the
+ * firmware's "trace: apply" lines can be matched to them. The top four
+ * bits hold the BabbleSim device number to keep several generators apart.
+ *
+ * With CONFIG_LOADGEN_DFU_KB, device 1 also uploads a firmware image over
+ * SMP next to its writes, see smp_upload.c.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/random/random.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include "bsim_args_runner.h"
+
+#include "ble_uuids.h"
+#include "ad_parse.h"
+#include "led_strip_src/led_strip.h"
+#include "smp_upload.h"
+
+#define SEQ_BITS 20
+#define TICK K_USEC(USEC_PER_SEC / CONFIG_LOADGEN_RATE_HZ)
+
+enum op { OP_LED, OP_MOTOR, OP_CFG, OP_COUNT };
+
+static const char *const op_name[OP_COUNT] = { "led", "motor", "cfg" };
+static const struct bt_uuid_128 *const op_uuid[OP_COUNT] = {
+	&led_char_uuid, &motor_char_uuid, &motor_config_char_uuid,
+};
+static uint16_t op_handle[OP_COUNT];
+
+static const struct bt_uuid_128 smp_uuid = BT_UUID_INIT_128(SMP_CHR_UUID_VAL);
+static uint16_t smp_handle;
+
+struct write_slot {
+	struct bt_gatt_write_params params;
+	uint32_t seq;
+	uint8_t data[sizeof(led_cmd_t)];
+	bool busy;
+};
+
+static struct write_slot slots[CONFIG_LOADGEN_INFLIGHT];
+static struct bt_conn *conn;
+static struct bt_gatt_discover_params disc;
+static uint32_t dev_id;
+static uint32_t next_seq;
+static int64_t stop_at;
+
+static uint32_t sent, ok, errs, backpressure;
+
+static K_SEM_DEFINE(ready, 0, 1);
+
+static inline uint64_t now_us(void)
+{
+	return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static void write_rsp(struct bt_conn *c, uint8_t err, struct bt_gatt_write_params *params)
+{
+	struct write_slot *slot = CONTAINER_OF(params, struct write_slot, params);
+
+	printk("lg: rsp %u err %u t %llu\n", slot->seq, err, now_us());
+	if (err) {
+		errs++;
+	} else {
+		ok++;
+	}
+	slot->busy = false;
+}
+
+static enum op pick_op(void)
+{
+	uint32_t r = sys_rand32_get() % 100;
+
+	if (r < CONFIG_LOADGEN_MIX_LED) {
+		return OP_LED;
+	}
+	if (r < CONFIG_LOADGEN_MIX_LED + CONFIG_LOADGEN_MIX_MOTOR) {
+		return OP_MOTOR;
+	}
+	return OP_CFG;
+}
+
+static void send_one(void)
+{
+	struct write_slot *slot = NULL;
+	enum op op = pick_op();
+	uint32_t seq;
+
+	for (size_t i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (!slots[i].busy) {
+			slot = &slots[i];
+			break;
+		}
+	}
+	if (slot == NULL) {
+		backpressure++;
+		return;
+	}
+
+	seq = (dev_id << SEQ_BITS) | (next_seq++ & BIT_MASK(SEQ_BITS));
+	slot->seq = seq;
+	slot->params.func = write_rsp;
+	slot->params.handle = op_handle[op];
+	slot->params.offset = 0;
+	slot->params.data = slot->data;
+
+	if (op == OP_LED) {
+		led_cmd_t cmd = {
+			.mode = LED_MODE_RGB,
+			.r = seq >> 16, .g = seq >> 8, .b = seq,
+			.brightness = LED_BRIGHTNESS_MAX,
+			.duration = 0,
+		};
+
+		memcpy(slot->data, &cmd, sizeof(cmd));
+		slot->params.length = sizeof(cmd);
+	} else {
+		slot->data[0] = 1;
+		slot->params.length = 1;
+	}
+
+	slot->busy = true;
+	if (bt_gatt_write(conn, &slot->params)) {
+		slot->busy = false;
+		backpressure++;
+		return;
+	}
+
+	sent++;
+	printk("lg: tx %u %s t %llu\n", seq, op_name[op], now_us());
+}
+
+static uint8_t discover_cb(struct bt_conn *c, const struct bt_gatt_attr *attr,
+			   struct bt_gatt_discover_params *params)
+{
+	const struct bt_gatt_chrc *chrc;
+
+	if (attr == NULL) {
+		k_sem_give(&ready);
+		return BT_GATT_ITER_STOP;
+	}
+
+	chrc = attr->user_data;
+	for (int op = 0; op < OP_COUNT; op++) {
+		if (bt_uuid_cmp(chrc->uuid, &op_uuid[op]->uuid) == 0) {
+			op_handle[op] = chrc->value_handle;
+		}
+	}
+	if (bt_uuid_cmp(chrc->uuid, &smp_uuid.uuid) == 0) {
+		smp_handle = chrc->value_handle;
+	}
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static void connected(struct bt_conn *c, uint8_t err)
+{
+	if (err) {
+		printk("lg: connect failed %u\n", err);
+		return;
+	}
+
+	disc.func = discover_cb;
+	disc.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+	disc.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+	disc.type = BT_GATT_DISCOVER_CHARACTERISTIC;
+	bt_gatt_discover(c, &disc);
+}
+
+static void disconnected(struct bt_conn *c, uint8_t reason)
+{
+	printk("lg: disconnected reason %u\n", reason);
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+};
+
+#if CONFIG_LOADGEN_DFU_KB > 0
+static void dfu_thread(void *p1, void *p2, void *p3)
+{
+	uint32_t acked = 0;
+	int rc;
+
+	rc = smp_upload_prepare(conn, smp_handle);
+	if (rc) {
+		printk("lg: dfu done bytes 0 rc %d t %llu\n", rc, now_us());
+		return;
+	}
+
+	printk("lg: dfu start bytes %u t %llu\n", CONFIG_LOADGEN_DFU_KB * 1024, now_us());
+	rc = smp_upload(CONFIG_LOADGEN_DFU_KB * 1024, &acked);
+	printk("lg: dfu done bytes %u rc %d t %llu\n", acked, rc, now_us());
+}
+
+K_THREAD_DEFINE(dfu_tid, 2048, dfu_thread, NULL, NULL, NULL, 7, 0, SYS_FOREVER_MS);
+#endif
+
+static const uint8_t control_uuid[] = { BT_UUID_CONTROL_SERVICE_VAL };
+
+static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
+			 struct net_buf_simple *ad)
+{
+	if (conn || type != BT_GAP_ADV_TYPE_ADV_IND || !ad_has_uuid128(ad, control_uuid)) {
+		return;
+	}
+
+	bt_le_scan_stop();
+	if (bt_conn_le_create(addr, BT_CONN_LE_CREATE_CONN, BT_LE_CONN_PARAM_DEFAULT, &conn)) {
+		conn = NULL;
+		bt_le_scan_start(BT_LE_SCAN_PASSIVE, device_found);
+	}
+}
+
+int main(void)
+{
+	int64_t next;
+
+	dev_id = bsim_args_get_global_device_nbr() & BIT_MASK(24 - SEQ_BITS);
+
+	if (bt_enable(NULL)) {
+		printk("lg: bt_enable failed\n");
+		return 0;
+	}
+	bt_le_scan_start(BT_LE_SCAN_PASSIVE, device_found);
+
+	k_sem_take(&ready, K_FOREVER);
+#if CONFIG_LOADGEN_DFU_KB > 0
+	// one uploader is enough, the others keep writing
+	if (bsim_args_get_global_device_nbr() == 1 && smp_handle) {
+		k_thread_start(dfu_tid);
+	}
+#endif
+	printk("lg: start rate %u Hz mix led %u motor %u t %llu\n", CONFIG_LOADGEN_RATE_HZ,
+	       CONFIG_LOADGEN_MIX_LED, CONFIG_LOADGEN_MIX_MOTOR, now_us());
+
+	// absolute ticks so a slow write does not lower the rate
+	next = k_uptime_ticks();
+	stop_at = k_uptime_get() + CONFIG_LOADGEN_DURATION_S * MSEC_PER_SEC;
+	while (k_uptime_get() < stop_at) {
+		send_one();
+		next += TICK.ticks;
+		k_sleep(K_TIMEOUT_ABS_TICKS(next));
+	}
+
+	// let the last responses come back
+	k_sleep(K_MSEC(500));
+#if CONFIG_LOADGEN_DFU_KB > 0
+	k_thread_join(dfu_tid, K_FOREVER);
+#endif
+	printk("lg: done sent %u ok %u err %u backpressure %u\n", sent, ok, errs, backpressure);
+	return 0;
+}
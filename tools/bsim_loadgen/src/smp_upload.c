@@ -0,0 +1,289 @@
+/*
+ * Pipelined SMP image upload for the firmware update throughput test.
+ *
+ * The image is a valid MCUboot header followed by filler, which is all
+ * img_mgmt checks while uploading. Each request carries
+ * CONFIG_LOADGEN_DFU_CHUNK bytes and is split over write without response
+ * PDUs of ATT MTU - 3 bytes, which the firmware reassembles. Up to
+ * CONFIG_LOADGEN_DFU_WINDOW requests are in flight at a time.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#include "smp_upload.h"
+
+#define SMP_HDR_LEN      8
+#define SMP_OP_WRITE     2
+#define SMP_OP_WRITE_RSP 3
+#define SMP_GROUP_IMAGE  1
+#define SMP_ID_UPLOAD    1
+
+#define IMAGE_MAGIC      0x96f3b83d
+#define IMAGE_HDR_LEN    32
+
+#define CBOR_UINT 0
+#define CBOR_BSTR 2
+#define CBOR_TEXT 3
+#define CBOR_MAP  5
+
+static struct bt_conn *conn;
+static uint16_t handle;
+static struct bt_gatt_subscribe_params sub;
+
+static K_SEM_DEFINE(secured, 0, 1);
+static K_SEM_DEFINE(window, CONFIG_LOADGEN_DFU_WINDOW, CONFIG_LOADGEN_DFU_WINDOW);
+static atomic_t acked_off;
+static atomic_t rsp_rc;
+
+static uint8_t image_hdr[IMAGE_HDR_LEN];
+static uint8_t pkt[SMP_HDR_LEN + 32 + CONFIG_LOADGEN_DFU_CHUNK];
+
+static uint8_t *cbor_head(uint8_t *p, uint8_t major, uint32_t val)
+{
+	major <<= 5;
+	if (val < 24) {
+		*p++ = major | val;
+	} else if (val <= UINT8_MAX) {
+		*p++ = major | 24;
+		*p++ = val;
+	} else if (val <= UINT16_MAX) {
+		*p++ = major | 25;
+		sys_put_be16(val, p);
+		p += 2;
+	} else {
+		*p++ = major | 26;
+		sys_put_be32(val, p);
+		p += 4;
+	}
+	return p;
+}
+
+static uint8_t *cbor_key(uint8_t *p, const char *key)
+{
+	size_t len = strlen(key);
+
+	p = cbor_head(p, CBOR_TEXT, len);
+	memcpy(p, key, len);
+	return p + len;
+}
+
+static bool cbor_next(const uint8_t **p, const uint8_t *end, uint8_t *major, uint32_t *val)
+{
+	uint8_t ai;
+
+	if (*p >= end) {
+		return false;
+	}
+	*major = **p >> 5;
+	ai = *(*p)++ & 0x1f;
+
+	if (ai < 24) {
+		*val = ai;
+	} else if (ai == 24 && end - *p >= 1) {
+		*val = **p;
+		*p += 1;
+	} else if (ai == 25 && end - *p >= 2) {
+		*val = sys_get_be16(*p);
+		*p += 2;
+	} else if (ai == 26 && end - *p >= 4) {
+		*val = sys_get_be32(*p);
+		*p += 4;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/* Take "rc" and "off" from an upload response; other keys are skipped */
+static int parse_rsp(const uint8_t *data, uint16_t len, uint32_t *off)
+{
+	const uint8_t *p = data + SMP_HDR_LEN;
+	const uint8_t *end = data + len;
+	uint32_t pairs, klen, val;
+	uint8_t major;
+	int rc = 0;
+
+	if (len < SMP_HDR_LEN || (data[0] & 0x7) != SMP_OP_WRITE_RSP ||
+	    sys_get_be16(&data[4]) != SMP_GROUP_IMAGE) {
+		return -EBADMSG;
+	}
+	if (!cbor_next(&p, end, &major, &pairs) || major != CBOR_MAP) {
+		return -EBADMSG;
+	}
+
+	while (pairs--) {
+		const char *key;
+
+		if (!cbor_next(&p, end, &major, &klen) || major != CBOR_TEXT ||
+		    (uint32_t)(end - p) < klen) {
+			return -EBADMSG;
+		}
+		key = (const char *)p;
+		p += klen;
+		if (!cbor_next(&p, end, &major, &val)) {
+			return -EBADMSG;
+		}
+
+		if (major == CBOR_MAP) {
+			// SMP version 2 error, {"group": g, "rc": rc}
+			return -EIO;
+		}
+		if (major == CBOR_BSTR || major == CBOR_TEXT) {
+			p += MIN(val, (uint32_t)(end - p));
+		} else if (major == CBOR_UINT && klen == 2 && memcmp(key, "rc", 2) == 0) {
+			rc = val;
+		} else if (major == CBOR_UINT && klen == 3 && memcmp(key, "off", 3) == 0) {
+			*off = val;
+		}
+	}
+
+	return rc;
+}
+
+static uint8_t notify_cb(struct bt_conn *c, struct bt_gatt_subscribe_params *params,
+			 const void *data, uint16_t length)
+{
+	uint32_t off = 0;
+	int rc;
+
+	if (data == NULL) {
+		return BT_GATT_ITER_STOP;
+	}
+
+	rc = parse_rsp(data, length, &off);
+	if (rc) {
+		atomic_cas(&rsp_rc, 0, rc);
+	} else {
+		atomic_set(&acked_off, off);
+	}
+	k_sem_give(&window);
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static void security_changed(struct bt_conn *c, bt_security_t level,
+			     enum bt_security_err err)
+{
+	if (c == conn && !err && level >= BT_SECURITY_L2) {
+		k_sem_give(&secured);
+	}
+}
+
+BT_CONN_CB_DEFINE(smp_conn_callbacks) = {
+	.security_changed = security_changed,
+};
+
+static uint8_t image_byte(uint32_t off)
+{
+	return off < IMAGE_HDR_LEN ? image_hdr[off] : (uint8_t)(off * 7);
+}
+
+static size_t build_req(uint8_t seq, uint32_t size, uint32_t off, uint32_t len)
+{
+	uint8_t *p = pkt + SMP_HDR_LEN;
+	size_t body;
+
+	// the first request also announces the image length
+	p = cbor_head(p, CBOR_MAP, off == 0 ? 3 : 2);
+	if (off == 0) {
+		p = cbor_key(p, "len");
+		p = cbor_head(p, CBOR_UINT, size);
+	}
+	p = cbor_key(p, "off");
+	p = cbor_head(p, CBOR_UINT, off);
+	p = cbor_key(p, "data");
+	p = cbor_head(p, CBOR_BSTR, len);
+	for (uint32_t i = 0; i < len; i++) {
+		*p++ = image_byte(off + i);
+	}
+
+	body = p - (pkt + SMP_HDR_LEN);
+	pkt[0] = SMP_OP_WRITE;
+	pkt[1] = 0;
+	sys_put_be16(body, &pkt[2]);
+	sys_put_be16(SMP_GROUP_IMAGE, &pkt[4]);
+	pkt[6] = seq;
+	pkt[7] = SMP_ID_UPLOAD;
+	return SMP_HDR_LEN + body;
+}
+
+static int send_pkt(size_t len)
+{
+	size_t frag = bt_gatt_get_mtu(conn) - 3;
+	size_t sent = 0;
+	int err;
+
+	while (sent < len) {
+		size_t n = MIN(frag, len - sent);
+
+		err = bt_gatt_write_without_response(conn, handle, pkt + sent, n, false);
+		if (err == -ENOMEM) {
+			// out of ATT buffers, the link drains them
+			k_sleep(K_MSEC(1));
+			continue;
+		}
+		if (err) {
+			return err;
+		}
+		sent += n;
+	}
+	return 0;
+}
+
+int smp_upload_prepare(struct bt_conn *c, uint16_t value_handle)
+{
+	int err;
+
+	conn = c;
+	handle = value_handle;
+
+	err = bt_conn_set_security(conn, BT_SECURITY_L2);
+	if (err) {
+		return err;
+	}
+	if (bt_conn_get_security(conn) < BT_SECURITY_L2) {
+		k_sem_take(&secured, K_FOREVER);
+	}
+
+	sub.notify = notify_cb;
+	sub.value = BT_GATT_CCC_NOTIFY;
+	sub.value_handle = handle;
+	// Zephyr's SMP service puts the CCC right after the value
+	sub.ccc_handle = handle + 1;
+	return bt_gatt_subscribe(conn, &sub);
+}
+
+int smp_upload(uint32_t size, uint32_t *acked)
+{
+	uint8_t seq = 0;
+	uint32_t len;
+	int err = 0;
+
+	sys_put_le32(IMAGE_MAGIC, &image_hdr[0]);
+	sys_put_le16(IMAGE_HDR_LEN, &image_hdr[8]);   // ih_hdr_size
+	sys_put_le32(size - IMAGE_HDR_LEN, &image_hdr[12]);  // ih_img_size
+	image_hdr[20] = 1;                             // version 1.0.0
+
+	for (uint32_t off = 0; off < size && !atomic_get(&rsp_rc); off += len) {
+		k_sem_take(&window, K_FOREVER);
+		len = MIN(CONFIG_LOADGEN_DFU_CHUNK, size - off);
+		err = send_pkt(build_req(seq++, size, off, len));
+		if (err) {
+			break;
+		}
+	}
+
+	// wait for the responses still in flight
+	for (int i = 0; i < CONFIG_LOADGEN_DFU_WINDOW; i++) {
+		k_sem_take(&window, K_SECONDS(10));
+	}
+
+	*acked = atomic_get(&acked_off);
+	return err ? err : (int)atomic_get(&rsp_rc);
+}
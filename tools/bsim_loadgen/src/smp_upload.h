@@ -0,0 +1,24 @@
+#ifndef SMP_UPLOAD_H
+#define SMP_UPLOAD_H
+
+#include <stdint.h>
+#include <zephyr/bluetooth/conn.h>
+
+/** SMP characteristic of the mcumgr GATT transport */
+#define SMP_CHR_UUID_VAL \
+	BT_UUID_128_ENCODE(0xda2e7828, 0xfbce, 0x4e01, 0xae9e, 0x261174997c48)
+
+/**
+ * @brief Encrypt the link and subscribe to SMP responses; blocks. The
+ * firmware only accepts SMP on an encrypted link.
+ */
+int smp_upload_prepare(struct bt_conn *conn, uint16_t value_handle);
+
+/**
+ * @brief Upload a fake image of @p size bytes to slot1; blocks.
+ * @param acked set to the last offset the firmware confirmed
+ * @return 0, the first SMP error code, or a negative errno
+ */
+int smp_upload(uint32_t size, uint32_t *acked);
+
+#endif // SMP_UPLOAD_H